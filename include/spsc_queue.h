@@ -0,0 +1,37 @@
+/**
+ * spsc_queue.h
+ * Bounded lock-free queue between one producer thread and one consumer thread
+ */
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+/**
+ * Opaque queue of pointers
+ */
+typedef struct SpscQueue SpscQueue;
+
+/**
+ * Create a queue
+ * @param capacity Most items held at once (at least 1)
+ * @return New queue or NULL on failure
+ */
+SpscQueue* spsc_queue_create(int capacity);
+
+/**
+ * Free a queue (items still queued are not freed)
+ * @param queue Queue to destroy (may be NULL)
+ */
+void spsc_queue_destroy(SpscQueue *queue);
+
+/**
+ * Append an item, waiting while the queue is full. Producer thread only.
+ */
+void spsc_queue_push(SpscQueue *queue, void *item);
+
+/**
+ * Remove the oldest item, waiting while the queue is empty. Consumer thread only.
+ */
+void* spsc_queue_pop(SpscQueue *queue);
+
+#endif /* SPSC_QUEUE_H */
@@ -11,6 +11,7 @@
 #include <string.h>
 #include <math.h>
 #include <time.h>
+#include <stdint.h>
 
 /**
  * Structure to represent a PGM image
@@ -20,8 +21,74 @@ typedef struct {
     int height;         // Height of the image
     int max_gray;       // Maximum gray value
     unsigned char *data; // Image data
+    void *mapping;      // Read-only file mapping holding data (NULL when data is allocated)
+    size_t mapping_size; // Length of the mapping in bytes
 } PGMImage;
 
+/**
+ * Non-owning view of 8-bit pixels in caller memory. Rows may be padded, so
+ * a view can describe a sub-rectangle of a larger frame or a buffer owned
+ * by another library; operations on a view work on that memory in place.
+ */
+typedef struct {
+    unsigned char *data;    // First pixel of the view
+    int width;              // Width of the view in pixels
+    int height;             // Height of the view in pixels
+    size_t stride;          // Bytes from the start of one row to the next (>= width)
+} PGMImageView;
+
+/**
+ * Transform used to move blocks into the coefficient domain
+ */
+typedef enum {
+    STEGO_TRANSFORM_HAAR = 0,   // Orthonormal floating-point Haar (default)
+    STEGO_TRANSFORM_LIFTING = 1 // Integer-to-integer lifting Haar, bit-exact round trip
+} StegoTransform;
+
+/**
+ * Header version written by this library
+ */
+#define STEGO_HEADER_VERSION 1
+
+/**
+ * Side of the square of top-left pixels that carries the stego header (one
+ * bit per pixel); it lies inside the metadata block at every block size
+ */
+#define STEGO_HEADER_SIZE 8
+
+/**
+ * Contents of the header at the top left of a stego image
+ */
+typedef struct {
+    int version;                // STEGO_HEADER_VERSION
+    int secret_width;           // Dimensions of the embedded secret
+    int secret_height;
+    int block_size;             // Block size the payload was embedded with
+    int embedding_strength;
+    int use_random_blocks;      // Random block order (the seed is not recorded)
+    StegoTransform transform;
+} StegoHeader;
+
+/**
+ * Rectangle of a secret image, in secret pixels
+ */
+typedef struct {
+    int x, y;                   // Top-left corner
+    int width, height;
+} StegoRegion;
+
+/**
+ * Quality of an embed, gathered from the blocks it rewrote as it rewrote them
+ */
+typedef struct {
+    int64_t blocks_changed;     // Blocks whose pixels changed, the metadata block included
+    uint64_t squared_error;     // Sum of squared pixel differences from the cover
+    int max_abs_error;          // Largest absolute pixel difference
+    double mse;                 // Mean square error over the whole image
+    double psnr;                // PSNR in dB for a peak of 255 (100 when nothing changed)
+    double ssim;                // Mean SSIM over the image's aligned 8x8 tiles
+} StegoEmbedReport;
+
 /**
  * Configuration for steganography operations
  */
@@ -30,6 +97,8 @@ typedef struct {
     int embedding_strength;     // Embedding strength (1-10, higher means stronger embedding but lower quality)
     int use_random_blocks;      // Whether to use random blocks for embedding (increases security)
     unsigned long random_seed;  // Seed for random block selection
+    StegoTransform transform;   // Coefficient transform (must match between embed and extract)
+    int num_threads;            // Worker threads for the payload blocks (0 = one per processor)
 } StegoConfig;
 
 /**
@@ -38,6 +107,16 @@ typedef struct {
  */
 StegoConfig create_default_config();
 
+/**
+ * Allocate a pixel buffer for a PGMImage
+ * Buffers are 64-byte aligned (malloc alignment on Windows); large ones are
+ * aligned to 2 MiB and advised for transparent huge pages where available.
+ * The buffer is released with free() (free_pgm does this).
+ * @param count Number of pixels
+ * @return Buffer or NULL on failure
+ */
+unsigned char* pgm_alloc_pixels(size_t count);
+
 /**
  * Load a PGM image from a file
  * @param filename Path to the PGM file
@@ -45,6 +124,34 @@ StegoConfig create_default_config();
  */
 PGMImage* load_pgm(const char *filename);
 
+/**
+ * Map a PGM image into memory without copying its pixels
+ * The returned image's data points into a read-only mapping of the file, so it
+ * suits inputs that are only read (extraction, quality assessment); writing
+ * to it faults. Platforms without mmap fall back to load_pgm.
+ * @param filename Path to the PGM file
+ * @return Mapped PGM image structure or NULL on failure
+ */
+PGMImage* load_pgm_mapped(const char *filename);
+
+/**
+ * View of a whole PGM image (stride = width)
+ * @param img Image to view
+ * @return View of the image's pixels
+ */
+PGMImageView pgm_image_view(PGMImage *img);
+
+/**
+ * View of a sub-rectangle of another view, clipped to it
+ * @param view View to take the rectangle from
+ * @param x Left edge of the rectangle
+ * @param y Top edge of the rectangle
+ * @param width Width of the rectangle
+ * @param height Height of the rectangle
+ * @return View of the rectangle (empty if it lies outside the view)
+ */
+PGMImageView pgm_subview(const PGMImageView *view, int x, int y, int width, int height);
+
 /**
  * Save a PGM image to a file
  * @param img PGM image to save
@@ -54,11 +161,40 @@ PGMImage* load_pgm(const char *filename);
 int save_pgm(PGMImage *img, const char *filename);
 
 /**
- * Free memory allocated for a PGM image
+ * Free memory allocated for a PGM image, unmapping the pixels of a mapped one
  * @param img PGM image to free
  */
 void free_pgm(PGMImage *img);
 
+/**
+ * Parse a binary (P5) PGM header, leaving the file positioned at the first pixel
+ * @param file Open file positioned at the magic number
+ * @param width Receives the image width
+ * @param height Receives the image height
+ * @param max_gray Receives the maximum gray value
+ * @return 0 on success, -1 on failure
+ */
+int read_pgm_header(FILE *file, int *width, int *height, int *max_gray);
+
+/**
+ * Longest header format_pgm_header produces, including the terminator
+ */
+#define PGM_HEADER_MAX 80
+
+/**
+ * Format a binary (P5) PGM header into a buffer
+ * @param buffer Receives the header text (NUL-terminated)
+ * @param size Size of the buffer (PGM_HEADER_MAX always suffices)
+ * @return Header length in bytes, or -1 if it does not fit
+ */
+int format_pgm_header(char *buffer, size_t size, int width, int height, int max_gray);
+
+/**
+ * Write a binary (P5) PGM header; the pixels follow directly
+ * @return 0 on success, -1 on failure
+ */
+int write_pgm_header(FILE *file, int width, int height, int max_gray);
+
 /**
  * Embed a secret PGM image into a cover PGM image using G-let D3 steganography
  * @param cover Cover image where the secret will be hidden
@@ -68,6 +204,18 @@ void free_pgm(PGMImage *img);
  */
 PGMImage* embed_image_with_config(PGMImage *cover, PGMImage *secret, StegoConfig *config);
 
+/**
+ * Embed a secret PGM image into a cover PGM image and report the quality of
+ * the result (see stego_context_set_embed_report)
+ * @param cover Cover image that will hide the secret
+ * @param secret Secret image to hide
+ * @param config Steganography configuration (or NULL for default)
+ * @param report Receives the embed report
+ * @return New stego image or NULL on failure
+ */
+PGMImage* embed_image_with_report(PGMImage *cover, PGMImage *secret, StegoConfig *config,
+                                  StegoEmbedReport *report);
+
 /**
  * Embed a secret PGM image into a cover PGM image using default configuration
  * @param cover Cover image where the secret will be hidden
@@ -95,6 +243,441 @@ PGMImage* extract_image_with_config(PGMImage *stego, int width, int height, Steg
  */
 PGMImage* extract_image(PGMImage *stego, int width, int height);
 
+/**
+ * Extract a rectangle of a secret PGM image from a stego image
+ * @param stego Image containing the hidden data
+ * @param width Width of the secret image (if known, 0 otherwise)
+ * @param height Height of the secret image (if known, 0 otherwise)
+ * @param region Rectangle to extract; must lie inside the secret image
+ * @param config Steganography configuration (or NULL for default)
+ * @return Sub-image of the secret or NULL on failure
+ */
+PGMImage* extract_region_with_config(PGMImage *stego, int width, int height, const StegoRegion *region,
+                                     StegoConfig *config);
+
+/**
+ * Embed a secret image in place into pixels owned by the caller
+ * @param cover View of the cover pixels; receives the stego pixels
+ * @param secret Secret image to hide
+ * @param config Steganography configuration (or NULL for default)
+ * @return 0 on success, -1 on failure
+ */
+int embed_image_view(const PGMImageView *cover, PGMImage *secret, StegoConfig *config);
+
+/**
+ * Extract a secret image from pixels owned by the caller
+ * @param stego View of the stego pixels (only read)
+ * @param width Width of the secret image (if known, 0 otherwise)
+ * @param height Height of the secret image (if known, 0 otherwise)
+ * @param config Steganography configuration (or NULL for default)
+ * @return Extracted secret image (max gray 255) or NULL on failure
+ */
+PGMImage* extract_image_view(const PGMImageView *stego, int width, int height, StegoConfig *config);
+
+/**
+ * Embed a secret image into a cover image, writing the stego image directly
+ * into a memory-mapped output file instead of an intermediate buffer
+ * @param cover Cover image where the secret will be hidden
+ * @param secret Secret image to hide
+ * @param output_file Path where the stego PGM is written
+ * @param config Steganography configuration (or NULL for default)
+ * @return 0 on success, -1 on failure
+ */
+int embed_image_to_file(PGMImage *cover, PGMImage *secret, const char *output_file, StegoConfig *config);
+
+/**
+ * Embed a secret image into a cover file, streaming the cover one block row
+ * at a time so resident memory stays at a few strips plus the secret
+ * @param cover_file Path of the cover PGM
+ * @param secret Secret image to hide
+ * @param output_file Path where the stego PGM is written
+ * @param config Steganography configuration (or NULL for default)
+ * @return 0 on success, -1 on failure
+ */
+int embed_image_stream(const char *cover_file, PGMImage *secret, const char *output_file, StegoConfig *config);
+
+/**
+ * Extract a secret image from a stego file one block row at a time, writing
+ * secret rows to the output as they are decoded (random block order keeps
+ * the secret, which is block_size^2 times smaller than the cover, in memory)
+ * @param stego_file Path of the stego PGM
+ * @param output_file Path where the secret PGM is written
+ * @param width In: secret width if known (0 otherwise); out: width extracted
+ * @param height In: secret height if known (0 otherwise); out: height extracted
+ * @param config Steganography configuration (or NULL for default)
+ * @return 0 on success, -1 on failure
+ */
+int extract_image_stream(const char *stego_file, const char *output_file, int *width, int *height, StegoConfig *config);
+
+/**
+ * Rewrite only the blocks of a stego PGM file whose secret pixels changed
+ * (see stego_context_update_file)
+ * @param config Configuration the image was embedded with (or NULL for default)
+ * @return Number of blocks rewritten, or -1 on failure
+ */
+int64_t update_image_file(const char *stego_file, PGMImage *old_secret, PGMImage *new_secret, StegoConfig *config);
+
+/**
+ * Decode the stego header from the top-left STEGO_HEADER_SIZE square of pixels
+ * @param view Pixels of the image (only the header square is read)
+ * @param header Receives the header (may be NULL to only test for one)
+ * @return 0 if a valid header was found, -1 otherwise
+ */
+int stego_header_read(const PGMImageView *view, StegoHeader *header);
+
+/**
+ * Check whether a PGM file carries a payload, reading only its header pixels
+ * @param header Receives the header when one is found (may be NULL)
+ * @return 1 if the file carries a header, 0 if it does not, -1 if it is not a
+ *         readable binary PGM
+ */
+int stego_detect_file(const char *filename, StegoHeader *header);
+
+/**
+ * Detect payloads in files and directory trees on a pool of workers, writing
+ * one tab-separated line per file that carries a header:
+ *   path  secret_width  secret_height  block_size  strength  random  transform
+ * Directories are walked recursively (symbolic links to directories are not
+ * followed); files that are not binary PGMs are skipped.
+ * @param paths Files or directories to scan
+ * @param count Number of paths
+ * @param report Stream receiving the lines (in scan order)
+ * @param num_threads Workers (0 for one per processor)
+ * @param scanned Receives the number of files examined (may be NULL)
+ * @return Number of files carrying a header, or -1 on failure
+ */
+int stego_detect_scan(const char *const *paths, int count, FILE *report, int num_threads, int *scanned);
+
+/**
+ * Severity of a message reported through a context's log callback
+ */
+typedef enum {
+    STEGO_LOG_ERROR = 0,        // The operation failed
+    STEGO_LOG_INFO = 1          // Progress and detected configuration
+} StegoLogLevel;
+
+/**
+ * Log callback of a context
+ * @param user Pointer registered with the callback
+ * @param level Message severity
+ * @param message Message text without trailing newline
+ */
+typedef void (*StegoLogFn)(void *user, StegoLogLevel level, const char *message);
+
+/**
+ * Library state for one caller: configuration, worker pool and embedding
+ * scratch reused between operations, random generator and log callback.
+ * Nothing in the library is shared between contexts, so threads that each
+ * own a context can run operations concurrently. A single context must not
+ * be used by two threads at once.
+ */
+typedef struct StegoContext StegoContext;
+
+/**
+ * Create a context
+ * The default log callback writes errors to stderr and drops other messages;
+ * the library itself never writes to stdout.
+ * @param config Initial configuration (or NULL for default)
+ * @return New context or NULL on failure
+ */
+StegoContext* stego_context_create(const StegoConfig *config);
+
+/**
+ * Destroy a context, stopping its workers and releasing its scratch buffers
+ * @param ctx Context to destroy (may be NULL)
+ */
+void stego_context_destroy(StegoContext *ctx);
+
+/**
+ * Configuration of a context; it may be changed between operations, and
+ * extraction writes the configuration found in the metadata block back here
+ */
+StegoConfig* stego_context_config(StegoContext *ctx);
+
+/**
+ * Replace the log callback of a context
+ * @param log Callback (NULL discards every message)
+ * @param user Pointer handed to the callback
+ */
+void stego_context_set_log(StegoContext *ctx, StegoLogFn log, void *user);
+
+/**
+ * Have every later embed through a context fill in a report. The report
+ * costs no extra pass over the images: each rewritten block is compared
+ * with its cover pixels while both are in cache. MSE and PSNR are exact.
+ * SSIM is taken over the aligned 8x8 tiles of the image, the tiles no
+ * block touched scoring exactly 1, so it tracks calculate_ssim (which also
+ * scores every offset between tiles) without equalling it.
+ * @param report Filled in by each successful embed (NULL stops reporting)
+ */
+void stego_context_set_embed_report(StegoContext *ctx, StegoEmbedReport *report);
+
+/**
+ * Reseed the context's random generator (seeded from random_seed at creation)
+ */
+void stego_context_seed(StegoContext *ctx, uint64_t seed);
+
+/**
+ * Next value of the context's random generator
+ */
+uint64_t stego_context_random(StegoContext *ctx);
+
+/**
+ * Embed a secret image in place into pixels owned by the caller
+ * @param cover View of the cover pixels; receives the stego pixels
+ * @param secret Secret image to hide
+ * @return 0 on success, -1 on failure
+ */
+int stego_context_embed(StegoContext *ctx, const PGMImageView *cover, PGMImage *secret);
+
+/**
+ * Embed a secret image into a cover image, writing the stego image through
+ * a shared mapping of the output file. An existing output file is replaced
+ * only once the embed succeeded, so the output may be the cover's own file.
+ * @param cover Cover image (only read)
+ * @param secret Secret image to hide
+ * @param output_file Path where the stego PGM is written
+ * @return 0 on success, -1 on failure
+ */
+int stego_context_embed_file(StegoContext *ctx, PGMImage *cover, PGMImage *secret, const char *output_file);
+
+/**
+ * Embed a secret image into a cover file, streaming the cover one block row
+ * at a time (see embed_image_stream)
+ * @param cover_file Path of the cover PGM
+ * @param secret Secret image to hide
+ * @param output_file Path where the stego PGM is written
+ * @return 0 on success, -1 on failure
+ */
+int stego_context_embed_stream(StegoContext *ctx, const char *cover_file, PGMImage *secret,
+                               const char *output_file);
+
+/**
+ * Extract a secret image from pixels owned by the caller
+ * @param stego View of the stego pixels (only read)
+ * @param width Width of the secret image (if known, 0 otherwise)
+ * @param height Height of the secret image (if known, 0 otherwise)
+ * @return Extracted secret image (max gray 255) or NULL on failure
+ */
+PGMImage* stego_context_extract(StegoContext *ctx, const PGMImageView *stego, int width, int height);
+
+/**
+ * Extract a rectangle of a secret image, decoding only the blocks that
+ * carry its pixels (through the random block order when one is used)
+ * @param stego View of the stego pixels (only read)
+ * @param width Width of the secret image (if known, 0 otherwise)
+ * @param height Height of the secret image (if known, 0 otherwise)
+ * @param region Rectangle to extract; must lie inside the secret image
+ * @return Sub-image of the secret (max gray 255) or NULL on failure
+ */
+PGMImage* stego_context_extract_region(StegoContext *ctx, const PGMImageView *stego, int width, int height,
+                                       const StegoRegion *region);
+
+/**
+ * Rewrite in place only the blocks of a stego image whose secret pixels
+ * changed. The block size, strength, block order and transform are read
+ * from the stego header into the context's configuration, as an extraction
+ * does, so only the seed of a random order has to match the embed (images
+ * without a header use the configuration as given). With the Haar
+ * transform the result is the image a full embed of the new secret would
+ * give (unless the old embed saturated pixels); with lifting, blocks carry
+ * the new pixels but may differ from a full embed by the margins already
+ * forced into their coefficients.
+ * @param stego View of the stego pixels; receives the updated pixels
+ * @param old_secret Secret currently embedded; with lifting, NULL reads it back
+ *                   from the image instead (which reads every payload block)
+ * @param new_secret Revised secret, of the embedded secret's dimensions
+ *                   (other dimensions are refused; a resized secret needs a
+ *                   full embed)
+ * @return Number of blocks rewritten, or -1 on failure
+ */
+int64_t stego_context_update(StegoContext *ctx, const PGMImageView *stego, PGMImage *old_secret,
+                             PGMImage *new_secret);
+
+/**
+ * Like stego_context_update on a stego PGM file, writing back only the pixel
+ * rows of the rewritten blocks
+ * @return Number of blocks rewritten, or -1 on failure
+ */
+int64_t stego_context_update_file(StegoContext *ctx, const char *stego_file, PGMImage *old_secret,
+                                  PGMImage *new_secret);
+
+/**
+ * Forward-transformed blocks of one cover, reused across embeds of many
+ * secrets into that cover. The coefficients depend only on the cover pixels
+ * and the block size (not on the seed), so one cache serves every key.
+ */
+typedef struct StegoCoverCache StegoCoverCache;
+
+/**
+ * Transform a cover's blocks with the context's block size
+ * Only lifting embedding reads a cache; for the Haar transform, whose embeds
+ * already apply precomputed delta patterns, the cache holds no blocks.
+ * @param cover View of the cover pixels (only read)
+ * @param max_bytes Most coefficient bytes to keep (0 for no bound); blocks
+ *                  beyond the bound are transformed at embed time as usual
+ * @return New cache or NULL on failure
+ */
+StegoCoverCache* stego_cover_cache_create(StegoContext *ctx, const PGMImageView *cover, size_t max_bytes);
+
+/**
+ * Write a cache to a file that stego_cover_cache_load maps back in
+ * @return 0 on success, -1 on failure
+ */
+int stego_cover_cache_save(const StegoCoverCache *cache, const char *filename);
+
+/**
+ * Map a cache file saved for a cover
+ * @param cover View of the cover the cache must have been built from
+ * @return Cache, or NULL when the file is missing, corrupt or built from
+ *         other pixels
+ */
+StegoCoverCache* stego_cover_cache_load(const char *filename, const PGMImageView *cover);
+
+/**
+ * Free a cache (or unmap a loaded one)
+ * @param cache Cache to free (may be NULL)
+ */
+void stego_cover_cache_free(StegoCoverCache *cache);
+
+/**
+ * Embed a secret image in place into a copy of a cached cover
+ * The output is identical to stego_context_embed on the same cover.
+ * @param cache Cache built from the cover with the context's block size
+ * @param stego View holding a copy of the cover pixels; receives the stego pixels
+ * @param secret Secret image to hide
+ * @return 0 on success, -1 on failure
+ */
+int stego_context_embed_cached(StegoContext *ctx, const StegoCoverCache *cache,
+                               const PGMImageView *stego, PGMImage *secret);
+
+/**
+ * Number of Feistel rounds of the block permutation (even: each round pair
+ * updates both halves once)
+ */
+#define STEGO_PERMUTATION_ROUNDS 4
+
+/**
+ * Keyed bijection on [0, size) used to scatter payload pixels over blocks.
+ * It is evaluated on demand in O(1) memory and holds no global state, so
+ * any thread can map any index independently.
+ */
+typedef struct {
+    uint64_t size;              // Number of permuted indices
+    int high_bits;              // Width of the high Feistel half
+    int low_bits;               // Width of the low Feistel half (high_bits or one more)
+    uint64_t low_mask;          // (1 << low_bits) - 1
+    uint64_t keys[STEGO_PERMUTATION_ROUNDS]; // Round keys derived from the seed
+} StegoPermutation;
+
+/**
+ * Initialize a permutation of [0, size) keyed by a seed
+ * @param perm Permutation to initialize
+ * @param size Number of indices to permute
+ * @param seed Key; embed and extract must use the same one
+ */
+void stego_permutation_init(StegoPermutation *perm, uint64_t size, unsigned long seed);
+
+/**
+ * Map an index to its position in the permutation
+ * @param perm Initialized permutation
+ * @param index Index in [0, size)
+ * @return Permuted position in [0, size)
+ */
+uint64_t stego_permutation_apply(const StegoPermutation *perm, uint64_t index);
+
+/**
+ * Map a permuted position back to its index (inverse of stego_permutation_apply)
+ * @param perm Initialized permutation
+ * @param value Position in [0, size)
+ * @return Index in [0, size) that maps to value
+ */
+uint64_t stego_permutation_invert(const StegoPermutation *perm, uint64_t value);
+
+/**
+ * Number of doubles of scratch space the G-let D3 transforms need for a block size
+ */
+#define GLET_D3_WORKSPACE_SIZE(size) (2 * (size))
+
+/**
+ * Largest block size the allocating transform wrappers handle with stack scratch
+ */
+#define GLET_D3_MAX_STACK_BLOCK_SIZE 64
+
+/**
+ * Haar scaling factor 1/sqrt(2), precomputed for the transform passes
+ */
+#define GLET_D3_INV_SQRT2 0.70710678118654752440
+
+/**
+ * Block transform entry point shared by the generic and size-specialized kernels
+ */
+typedef void (*GletTransformFn)(double *block, int size, double *workspace);
+
+/**
+ * Forward/inverse transform pair for one block size. A kernel transforms a
+ * tile of `lanes` interleaved blocks (coefficient k of block l at
+ * tile[k * lanes + l]) with a workspace of lanes * GLET_D3_WORKSPACE_SIZE(size)
+ * doubles; scalar kernels have a single lane, so a tile is a plain block.
+ */
+typedef struct {
+    int size;                   // Block size the kernel is specialized for
+    int lanes;                  // Number of blocks transformed together
+    GletTransformFn forward;    // Forward transform (in-place)
+    GletTransformFn inverse;    // Inverse transform (in-place)
+} GletKernel;
+
+/**
+ * Apply G-let D3 forward transform to an image block using caller-owned scratch
+ * @param block Image block data (in-place transformation)
+ * @param size Block size (must be a power of 2)
+ * @param workspace Scratch buffer of GLET_D3_WORKSPACE_SIZE(size) doubles
+ */
+void glet_d3_forward_ws(double *block, int size, double *workspace);
+
+/**
+ * Apply G-let D3 inverse transform to an image block using caller-owned scratch
+ * @param block Image block data (in-place transformation)
+ * @param size Block size (must be a power of 2)
+ * @param workspace Scratch buffer of GLET_D3_WORKSPACE_SIZE(size) doubles
+ */
+void glet_d3_inverse_ws(double *block, int size, double *workspace);
+
+/**
+ * Select the transform kernel for a block size: unrolled kernels for 4, 8, 16
+ * and 32, the generic runtime-size transform (the reference) otherwise.
+ * Every kernel accepts a GLET_D3_WORKSPACE_SIZE(size) workspace.
+ * @param size Block size (must be a power of 2)
+ * @return Kernel to use for every block of that size
+ */
+GletKernel glet_d3_select_kernel(int size);
+
+/**
+ * Number of blocks the integer lifting transform processes per tile; the
+ * per-lane inner loops are laid out so the compiler can vectorize them
+ */
+#define GLET_D3_INT_LANES 8
+
+/**
+ * Apply the integer-to-integer lifting G-let D3 forward transform (Haar
+ * S-transform) to a tile of interleaved blocks. The transform is exactly
+ * invertible: glet_d3_inverse_int restores the input bit for bit.
+ * @param tile Coefficient k of block l at tile[k * lanes + l] (in-place)
+ * @param size Block size (must be a power of 2)
+ * @param lanes Number of interleaved blocks (1 for a plain block)
+ * @param workspace Scratch buffer of lanes * GLET_D3_WORKSPACE_SIZE(size) int32 values
+ */
+void glet_d3_forward_int(int32_t *tile, int size, int lanes, int32_t *workspace);
+
+/**
+ * Apply the integer-to-integer lifting G-let D3 inverse transform to a tile
+ * @param tile Coefficient k of block l at tile[k * lanes + l] (in-place)
+ * @param size Block size (must be a power of 2)
+ * @param lanes Number of interleaved blocks (1 for a plain block)
+ * @param workspace Scratch buffer of lanes * GLET_D3_WORKSPACE_SIZE(size) int32 values
+ */
+void glet_d3_inverse_int(int32_t *tile, int size, int lanes, int32_t *workspace);
+
 /**
  * Apply G-let D3 forward transform to an image block
  * @param block Image block data
@@ -126,11 +709,184 @@ double calculate_psnr(PGMImage *original, PGMImage *modified);
 double calculate_mse(PGMImage *img1, PGMImage *img2);
 
 /**
- * Calculate the Structural Similarity Index (SSIM) between two images
+ * Side of the square SSIM window (clipped to smaller images)
+ */
+#define STEGO_SSIM_WINDOW 8
+
+/**
+ * Calculate the Structural Similarity Index (SSIM) between two images: the
+ * mean SSIM of every STEGO_SSIM_WINDOW-square window, at every pixel
+ * offset. The result is exact and reproducible.
  * @param img1 First image
  * @param img2 Second image
  * @return SSIM value (between -1 and 1, where 1 means identical images)
  */
 double calculate_ssim(PGMImage *img1, PGMImage *img2);
 
+/**
+ * Calculate SSIM like calculate_ssim on the context's worker pool; the
+ * result is the same for any thread count
+ * @param ctx Context whose pool runs the calculation
+ * @param img1 First image
+ * @param img2 Second image
+ * @return SSIM value (between -1 and 1, 1 means identical)
+ */
+double stego_context_ssim(StegoContext *ctx, PGMImage *img1, PGMImage *img2);
+
+/**
+ * Calculate SSIM like stego_context_ssim and keep the score of every window
+ * @param ctx Context whose pool runs the calculation
+ * @param img1 First image
+ * @param img2 Second image
+ * @param map Receives one score per window position, row by row: width -
+ *            STEGO_SSIM_WINDOW + 1 columns and height - STEGO_SSIM_WINDOW + 1
+ *            rows (one of each for images smaller than the window)
+ * @return SSIM value (the mean of the map)
+ */
+double stego_context_ssim_map(StegoContext *ctx, PGMImage *img1, PGMImage *img2, double *map);
+
+/**
+ * Calculate the multi-scale SSIM (MS-SSIM) between two images. Up to five
+ * scales, each half the size of the previous one (2x2 box average), are
+ * scored with the window of calculate_ssim: the finer scales by their
+ * contrast-structure term, the coarsest by its full SSIM. The terms are
+ * combined with the standard MS-SSIM weights, renormalised when the image
+ * is too small for every scale. Negative terms count as 0.
+ * @param img1 First image
+ * @param img2 Second image
+ * @return MS-SSIM value (between 0 and 1, 1 means identical), or -1 on failure
+ */
+double calculate_ms_ssim(PGMImage *img1, PGMImage *img2);
+
+/**
+ * Calculate MS-SSIM like calculate_ms_ssim on the context's worker pool;
+ * the result is the same for any thread count
+ * @param ctx Context whose pool runs the calculation
+ * @param img1 First image
+ * @param img2 Second image
+ * @return MS-SSIM value (between 0 and 1, 1 means identical), or -1 on failure
+ */
+double stego_context_ms_ssim(StegoContext *ctx, PGMImage *img1, PGMImage *img2);
+
+/**
+ * Quality of a modified image against its original
+ */
+typedef struct {
+    double mse;                 // Mean square error
+    double psnr;                // Peak signal-to-noise ratio in dB (100 for identical images)
+    double ssim;                // As calculate_ssim
+    int max_abs_error;          // Largest absolute pixel difference
+    uint64_t histogram[256];    // Pixels per absolute difference
+} StegoQualityMetrics;
+
+/**
+ * Calculate MSE, PSNR, SSIM, the largest pixel error and the error
+ * histogram in one pass over both images (each value as its own
+ * calculate_* function would give it)
+ * @param img1 Original image
+ * @param img2 Modified image
+ * @param metrics Receives the metrics
+ * @return 0 on success, -1 if the images are invalid or differ in size
+ */
+int compute_quality_metrics(PGMImage *img1, PGMImage *img2, StegoQualityMetrics *metrics);
+
+/**
+ * Calculate every quality metric like compute_quality_metrics on the
+ * context's worker pool; the result is the same for any thread count
+ * @param ctx Context whose pool runs the calculation
+ * @param img1 Original image
+ * @param img2 Modified image
+ * @param metrics Receives the metrics
+ * @return 0 on success, -1 if the images are invalid or differ in size
+ */
+int stego_context_quality_metrics(StegoContext *ctx, PGMImage *img1, PGMImage *img2,
+                                  StegoQualityMetrics *metrics);
+
+/**
+ * Quality of one embedding block of a modified image
+ */
+typedef struct {
+    double mse;                 // Mean square error over the block
+    double psnr;                // Peak signal-to-noise ratio in dB (100 for identical blocks)
+    double ssim;                // Mean SSIM of the windows inside the block
+    int max_abs_error;          // Largest absolute pixel difference in the block
+} StegoBlockQuality;
+
+/**
+ * Calculate the quality of every block of the embedding grid on the
+ * context's worker pool. The grid is that of an embed with the context's
+ * block size: whole blocks only, numbered row by row from the top left as
+ * embedding block indices are, so entry 0 is the metadata block. Windows are
+ * clipped to the block, so a block's SSIM depends on its pixels alone.
+ * @param ctx Context giving the block size and the pool
+ * @param img1 Original image
+ * @param img2 Modified image
+ * @param block_size Receives the side of a block (the configured size
+ *                   rounded up to a power of 2, as an embed uses it)
+ * @param blocks_x Receives the blocks per row
+ * @param blocks_y Receives the block rows
+ * @return blocks_x * blocks_y block qualities (release with free()), or NULL
+ *         if the images are invalid, differ in size or hold no whole block
+ */
+StegoBlockQuality* stego_context_block_quality(StegoContext *ctx, PGMImage *img1, PGMImage *img2,
+                                               int *block_size, int *blocks_x, int *blocks_y);
+
+/**
+ * Draw block qualities as a heatmap: each block of the grid is filled with
+ * its MSE scaled so that the worst block is 255 (all 0 when no block
+ * changed); pixels outside whole blocks are 0
+ * @param blocks Block qualities from stego_context_block_quality
+ * @param blocks_x Blocks per row
+ * @param blocks_y Block rows
+ * @param block_size Side of a block in pixels
+ * @param width Width of the heatmap (the assessed image's width)
+ * @param height Height of the heatmap
+ * @return Heatmap image or NULL on failure
+ */
+PGMImage* stego_block_quality_heatmap(const StegoBlockQuality *blocks, int blocks_x, int blocks_y,
+                                      int block_size, int width, int height);
+
+/**
+ * Write block qualities as CSV with a header line and one row per block:
+ * block, x, y (pixel position of the block's top-left corner), mse, psnr,
+ * ssim and max_abs_error
+ * @param blocks Block qualities from stego_context_block_quality
+ * @param blocks_x Blocks per row
+ * @param blocks_y Block rows
+ * @param block_size Side of a block in pixels
+ * @param file Stream receiving the table
+ * @return 0 on success, -1 on a write error
+ */
+int stego_block_quality_write_csv(const StegoBlockQuality *blocks, int blocks_x, int blocks_y,
+                                  int block_size, FILE *file);
+
+/**
+ * Run a manifest of embed, extract and assess jobs side by side on a
+ * work-stealing pool and write a tab-separated report with one row per job.
+ * Manifest lines use the command line syntax without the program name:
+ *   embed <cover> <secret> <output> [-b N] [-s N] [-r] [-seed N] [-l]
+ *   extract <stego> <output> [width height] [options]
+ *   assess <original> <modified>
+ * Blank lines and lines starting with '#' are skipped; paths cannot contain spaces.
+ * @param manifest_file Path of the manifest
+ * @param report Stream receiving the report
+ * @param defaults Configuration of jobs that do not override it (or NULL for default)
+ * @param num_threads Jobs run at once (0 for one per processor); each job is single-threaded
+ * @return Number of failed jobs, or -1 if the manifest could not be read
+ */
+int stego_batch_run(const char *manifest_file, FILE *report, const StegoConfig *defaults, int num_threads);
+
+/**
+ * Run a manifest like stego_batch_run, but one job at a time in manifest
+ * order through overlapping stages: the inputs of the next jobs are read
+ * and the outputs of the previous ones written while the current job is
+ * transformed on every worker
+ * @param manifest_file Path of the manifest
+ * @param report Stream receiving the report
+ * @param defaults Configuration of jobs that do not override it (or NULL for default)
+ * @param num_threads Workers transforming each job (0 for one per processor)
+ * @return Number of failed jobs, or -1 if the manifest could not be read
+ */
+int stego_batch_pipeline(const char *manifest_file, FILE *report, const StegoConfig *defaults, int num_threads);
+
 #endif /* STEGANOGRAPHY_H */ 
\ No newline at end of file
@@ -0,0 +1,73 @@
+/**
+ * thread_pool.h
+ * Fixed-size worker pool for splitting independent block ranges across cores
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stdint.h>
+
+/**
+ * Opaque worker pool
+ */
+typedef struct ThreadPool ThreadPool;
+
+/**
+ * Work callback for one chunk of a parallel loop
+ * @param arg Caller data passed to thread_pool_parallel_for
+ * @param begin First index of the chunk
+ * @param end One past the last index of the chunk
+ * @param worker Index of the worker running the chunk (0 is the calling thread),
+ *               for selecting per-worker scratch buffers
+ */
+typedef void (*ThreadPoolRangeFn)(void *arg, int64_t begin, int64_t end, int worker);
+
+/**
+ * Number of processors available to this process (at least 1)
+ */
+int thread_pool_cpu_count(void);
+
+/**
+ * Create a pool with `num_threads` workers including the calling thread
+ * @param num_threads Number of workers (0 for one per processor)
+ * @return New pool or NULL on failure
+ */
+ThreadPool* thread_pool_create(int num_threads);
+
+/**
+ * Stop the workers and free the pool
+ * @param pool Pool to destroy (may be NULL)
+ */
+void thread_pool_destroy(ThreadPool *pool);
+
+/**
+ * Number of workers in a pool, including the calling thread
+ */
+int thread_pool_size(const ThreadPool *pool);
+
+/**
+ * Run fn over [0, count) in chunks of `chunk` indices on every worker and
+ * wait for all of them. Chunks are handed out dynamically, so callbacks must
+ * only write state owned by their own indices (or by their worker).
+ * @param pool Pool to run on (NULL runs everything on the calling thread)
+ * @param count Number of indices
+ * @param chunk Indices per chunk (at least 1)
+ * @param fn Work callback
+ * @param arg Caller data for fn
+ */
+void thread_pool_parallel_for(ThreadPool *pool, int64_t count, int64_t chunk, ThreadPoolRangeFn fn, void *arg);
+
+/**
+ * Run fn once for every task in [0, count) and wait for all of them. Each
+ * worker starts with a contiguous run of tasks; a worker that finishes its
+ * run steals the back half of another worker's, so tasks of very different
+ * cost still keep every worker busy. fn is called with end == begin + 1.
+ * @param pool Pool to run on (NULL runs everything on the calling thread)
+ * @param count Number of tasks
+ * @param fn Work callback
+ * @param arg Caller data for fn
+ */
+void thread_pool_run_tasks(ThreadPool *pool, int64_t count, ThreadPoolRangeFn fn, void *arg);
+
+#endif /* THREAD_POOL_H */
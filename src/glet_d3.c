@@ -5,86 +5,74 @@
 
 #include "../include/steganography.h"
 
+/**
+ * Loop unrolling hint for the size-specialized kernels
+ */
+#if defined(__clang__)
+#define GLET_D3_UNROLL _Pragma("unroll")
+#define GLET_D3_UNROLL_ROWS _Pragma("unroll 8")
+#elif defined(__GNUC__)
+#define GLET_D3_UNROLL _Pragma("GCC unroll 32")
+#define GLET_D3_UNROLL_ROWS _Pragma("GCC unroll 8")
+#else
+#define GLET_D3_UNROLL
+#define GLET_D3_UNROLL_ROWS
+#endif
+
 /**
  * Apply Haar wavelet transform to a 1D array (in-place)
  * @param data Input/output data array
  * @param size Size of the array (must be a power of 2)
+ * @param temp Scratch buffer of at least size elements
  */
-static void haar_transform_1d(double *data, int size) {
-    double *temp = (double *)malloc(size * sizeof(double));
-    if (!temp) return;
-
-    for (int stride = 1; stride < size; stride *= 2) {
-        int half_stride = stride;
-        stride *= 2;
-
-        for (int i = 0; i < size; i += stride) {
-            for (int j = 0; j < half_stride; j++) {
-                int idx = i + j;
-                int idx_pair = i + j + half_stride;
-                
-                temp[idx / 2] = (data[idx] + data[idx_pair]) / sqrt(2.0);
-                temp[size / 2 + idx / 2] = (data[idx] - data[idx_pair]) / sqrt(2.0);
-            }
+static void haar_transform_1d(double *data, int size, double *temp) {
+    // Each level splits the current low band into averages and details
+    for (int length = size; length > 1; length /= 2) {
+        int half = length / 2;
+
+        for (int i = 0; i < half; i++) {
+            temp[i] = (data[2 * i] + data[2 * i + 1]) * GLET_D3_INV_SQRT2;
+            temp[half + i] = (data[2 * i] - data[2 * i + 1]) * GLET_D3_INV_SQRT2;
         }
 
-        for (int i = 0; i < size; i++) {
+        for (int i = 0; i < length; i++) {
             data[i] = temp[i];
         }
     }
-
-    free(temp);
 }
 
 /**
  * Apply inverse Haar wavelet transform to a 1D array (in-place)
  * @param data Input/output data array
  * @param size Size of the array (must be a power of 2)
+ * @param temp Scratch buffer of at least size elements
  */
-static void haar_inverse_1d(double *data, int size) {
-    double *temp = (double *)malloc(size * sizeof(double));
-    if (!temp) return;
-
-    for (int stride = size; stride > 1; stride /= 2) {
-        int half_stride = stride / 2;
-
-        for (int i = 0; i < size; i += stride) {
-            for (int j = 0; j < half_stride; j++) {
-                int idx = i + j;
-                int idx_pair = i + j + half_stride;
-                
-                // Using integer division for array indexing
-                temp[idx] = (data[idx / 2] + data[size / 2 + idx / 2]) / sqrt(2.0);
-                temp[idx_pair] = (data[idx / 2] - data[size / 2 + idx / 2]) / sqrt(2.0);
-            }
+static void haar_inverse_1d(double *data, int size, double *temp) {
+    // Undo the levels in reverse order, starting from the coarsest band
+    for (int length = 2; length <= size; length *= 2) {
+        int half = length / 2;
+
+        for (int i = 0; i < half; i++) {
+            temp[2 * i] = (data[i] + data[half + i]) * GLET_D3_INV_SQRT2;
+            temp[2 * i + 1] = (data[i] - data[half + i]) * GLET_D3_INV_SQRT2;
         }
 
-        for (int i = 0; i < size; i++) {
+        for (int i = 0; i < length; i++) {
             data[i] = temp[i];
         }
     }
-
-    free(temp);
 }
 
 /**
- * Apply G-let D3 forward transform to an image block
- * @param block Image block data (in-place transformation)
- * @param size Block size (must be a power of 2)
+ * Apply G-let D3 forward transform to an image block using caller-owned scratch
  */
-void glet_d3_forward(double *block, int size) {
-    double *temp_row = (double *)malloc(size * sizeof(double));
-    if (!temp_row) return;
+void glet_d3_forward_ws(double *block, int size, double *workspace) {
+    double *temp_row = workspace;
+    double *temp = workspace + size;
 
     // Apply 1D transform to each row
     for (int i = 0; i < size; i++) {
-        for (int j = 0; j < size; j++) {
-            temp_row[j] = block[i * size + j];
-        }
-        haar_transform_1d(temp_row, size);
-        for (int j = 0; j < size; j++) {
-            block[i * size + j] = temp_row[j];
-        }
+        haar_transform_1d(block + i * size, size, temp);
     }
 
     // Apply 1D transform to each column
@@ -92,30 +80,26 @@ void glet_d3_forward(double *block, int size) {
         for (int i = 0; i < size; i++) {
             temp_row[i] = block[i * size + j];
         }
-        haar_transform_1d(temp_row, size);
+        haar_transform_1d(temp_row, size, temp);
         for (int i = 0; i < size; i++) {
             block[i * size + j] = temp_row[i];
         }
     }
-
-    free(temp_row);
 }
 
 /**
- * Apply G-let D3 inverse transform to an image block
- * @param block Image block data (in-place transformation)
- * @param size Block size (must be a power of 2)
+ * Apply G-let D3 inverse transform to an image block using caller-owned scratch
  */
-void glet_d3_inverse(double *block, int size) {
-    double *temp_row = (double *)malloc(size * sizeof(double));
-    if (!temp_row) return;
+void glet_d3_inverse_ws(double *block, int size, double *workspace) {
+    double *temp_row = workspace;
+    double *temp = workspace + size;
 
     // Apply 1D inverse transform to each column
     for (int j = 0; j < size; j++) {
         for (int i = 0; i < size; i++) {
             temp_row[i] = block[i * size + j];
         }
-        haar_inverse_1d(temp_row, size);
+        haar_inverse_1d(temp_row, size, temp);
         for (int i = 0; i < size; i++) {
             block[i * size + j] = temp_row[i];
         }
@@ -123,14 +107,254 @@ void glet_d3_inverse(double *block, int size) {
 
     // Apply 1D inverse transform to each row
     for (int i = 0; i < size; i++) {
-        for (int j = 0; j < size; j++) {
-            temp_row[j] = block[i * size + j];
+        haar_inverse_1d(block + i * size, size, temp);
+    }
+}
+
+/**
+ * Apply G-let D3 forward transform to an image block
+ * @param block Image block data (in-place transformation)
+ * @param size Block size (must be a power of 2)
+ */
+void glet_d3_forward(double *block, int size) {
+    double scratch[GLET_D3_WORKSPACE_SIZE(GLET_D3_MAX_STACK_BLOCK_SIZE)];
+
+    if (size <= GLET_D3_MAX_STACK_BLOCK_SIZE) {
+        glet_d3_forward_ws(block, size, scratch);
+        return;
+    }
+
+    double *workspace = (double *)malloc(GLET_D3_WORKSPACE_SIZE(size) * sizeof(double));
+    if (!workspace) return;
+
+    glet_d3_forward_ws(block, size, workspace);
+    free(workspace);
+}
+
+/**
+ * Apply G-let D3 inverse transform to an image block
+ * @param block Image block data (in-place transformation)
+ * @param size Block size (must be a power of 2)
+ */
+void glet_d3_inverse(double *block, int size) {
+    double scratch[GLET_D3_WORKSPACE_SIZE(GLET_D3_MAX_STACK_BLOCK_SIZE)];
+
+    if (size <= GLET_D3_MAX_STACK_BLOCK_SIZE) {
+        glet_d3_inverse_ws(block, size, scratch);
+        return;
+    }
+
+    double *workspace = (double *)malloc(GLET_D3_WORKSPACE_SIZE(size) * sizeof(double));
+    if (!workspace) return;
+
+    glet_d3_inverse_ws(block, size, workspace);
+    free(workspace);
+}
+
+/**
+ * Define forward and inverse kernels for a fixed block size N. The 1D passes
+ * are the same operations as haar_transform_1d/haar_inverse_1d (so results
+ * are bit-identical) with every level unrolled into straight-line code.
+ * Rows and columns are unrolled up to 8 at a time, so 4x4 and 8x8 blocks
+ * run without any loop while 16x16 and 32x32 keep their code size in check.
+ */
+#define GLET_D3_DEFINE_KERNELS(N)                                          \
+static inline void haar_transform_##N(double *data, int stride) {          \
+    double band[N];                                                        \
+    double temp[N];                                                        \
+    GLET_D3_UNROLL                                                         \
+    for (int i = 0; i < N; i++) {                                          \
+        band[i] = data[i * stride];                                        \
+    }                                                                      \
+    GLET_D3_UNROLL                                                         \
+    for (int length = N; length > 1; length /= 2) {                        \
+        int half = length / 2;                                             \
+        GLET_D3_UNROLL                                                     \
+        for (int i = 0; i < half; i++) {                                   \
+            temp[i] = (band[2 * i] + band[2 * i + 1]) * GLET_D3_INV_SQRT2; \
+            temp[half + i] = (band[2 * i] - band[2 * i + 1]) * GLET_D3_INV_SQRT2; \
+        }                                                                  \
+        GLET_D3_UNROLL                                                     \
+        for (int i = 0; i < length; i++) {                                 \
+            band[i] = temp[i];                                             \
+        }                                                                  \
+    }                                                                      \
+    GLET_D3_UNROLL                                                         \
+    for (int i = 0; i < N; i++) {                                          \
+        data[i * stride] = band[i];                                        \
+    }                                                                      \
+}                                                                          \
+static inline void haar_inverse_##N(double *data, int stride) {            \
+    double band[N];                                                        \
+    double temp[N];                                                        \
+    GLET_D3_UNROLL                                                         \
+    for (int i = 0; i < N; i++) {                                          \
+        band[i] = data[i * stride];                                        \
+    }                                                                      \
+    GLET_D3_UNROLL                                                         \
+    for (int length = 2; length <= N; length *= 2) {                       \
+        int half = length / 2;                                             \
+        GLET_D3_UNROLL                                                     \
+        for (int i = 0; i < half; i++) {                                   \
+            temp[2 * i] = (band[i] + band[half + i]) * GLET_D3_INV_SQRT2;  \
+            temp[2 * i + 1] = (band[i] - band[half + i]) * GLET_D3_INV_SQRT2; \
+        }                                                                  \
+        GLET_D3_UNROLL                                                     \
+        for (int i = 0; i < length; i++) {                                 \
+            band[i] = temp[i];                                             \
+        }                                                                  \
+    }                                                                      \
+    GLET_D3_UNROLL                                                         \
+    for (int i = 0; i < N; i++) {                                          \
+        data[i * stride] = band[i];                                        \
+    }                                                                      \
+}                                                                          \
+static void glet_d3_forward_##N(double *block, int size, double *workspace) { \
+    (void)size;                                                            \
+    (void)workspace;                                                       \
+    GLET_D3_UNROLL_ROWS                                                    \
+    for (int i = 0; i < N; i++) {                                          \
+        haar_transform_##N(block + i * N, 1);                              \
+    }                                                                      \
+    GLET_D3_UNROLL_ROWS                                                    \
+    for (int j = 0; j < N; j++) {                                          \
+        haar_transform_##N(block + j, N);                                  \
+    }                                                                      \
+}                                                                          \
+static void glet_d3_inverse_##N(double *block, int size, double *workspace) { \
+    (void)size;                                                            \
+    (void)workspace;                                                       \
+    GLET_D3_UNROLL_ROWS                                                    \
+    for (int j = 0; j < N; j++) {                                          \
+        haar_inverse_##N(block + j, N);                                    \
+    }                                                                      \
+    GLET_D3_UNROLL_ROWS                                                    \
+    for (int i = 0; i < N; i++) {                                          \
+        haar_inverse_##N(block + i * N, 1);                                \
+    }                                                                      \
+}
+
+GLET_D3_DEFINE_KERNELS(4)
+GLET_D3_DEFINE_KERNELS(8)
+GLET_D3_DEFINE_KERNELS(16)
+GLET_D3_DEFINE_KERNELS(32)
+
+/**
+ * Dispatch table of the size-specialized kernels
+ */
+static const GletKernel glet_d3_kernels[] = {
+    { 4, 1, glet_d3_forward_4, glet_d3_inverse_4 },
+    { 8, 1, glet_d3_forward_8, glet_d3_inverse_8 },
+    { 16, 1, glet_d3_forward_16, glet_d3_inverse_16 },
+    { 32, 1, glet_d3_forward_32, glet_d3_inverse_32 }
+};
+
+/**
+ * Select the transform kernel for a block size
+ */
+GletKernel glet_d3_select_kernel(int size) {
+    for (size_t i = 0; i < sizeof(glet_d3_kernels) / sizeof(glet_d3_kernels[0]); i++) {
+        if (glet_d3_kernels[i].size == size) {
+            return glet_d3_kernels[i];
         }
-        haar_inverse_1d(temp_row, size);
-        for (int j = 0; j < size; j++) {
-            block[i * size + j] = temp_row[j];
+    }
+
+    // Generic runtime-size path for every other block size
+    GletKernel generic = { size, 1, glet_d3_forward_ws, glet_d3_inverse_ws };
+    return generic;
+}
+
+/**
+ * Floor of h / 2 for signed values (an arithmetic right shift, spelled out
+ * portably)
+ */
+static inline int32_t floor_half(int32_t h) {
+    return (h - (h & 1)) / 2;
+}
+
+/**
+ * Apply the lifting Haar (S-transform) to one row or column of a tile
+ * @param data First coefficient; each coefficient holds `lanes` block values
+ * @param size Number of coefficients (must be a power of 2)
+ * @param stride Distance between consecutive coefficients in int32 elements
+ * @param lanes Number of interleaved blocks
+ * @param temp Scratch buffer of at least size * lanes elements
+ */
+static void lifting_transform_1d(int32_t *data, int size, int stride, int lanes, int32_t *temp) {
+    for (int length = size; length > 1; length /= 2) {
+        int half = length / 2;
+
+        for (int i = 0; i < half; i++) {
+            const int32_t *even = data + 2 * i * stride;
+            const int32_t *odd = data + (2 * i + 1) * stride;
+            int32_t *low = temp + i * lanes;
+            int32_t *high = temp + (half + i) * lanes;
+
+            // Predict the odd sample from the even one, then update the average
+            for (int l = 0; l < lanes; l++) {
+                int32_t h = even[l] - odd[l];
+                high[l] = h;
+                low[l] = odd[l] + floor_half(h);
+            }
+        }
+
+        for (int i = 0; i < length; i++) {
+            memcpy(data + i * stride, temp + i * lanes, lanes * sizeof(int32_t));
         }
     }
+}
 
-    free(temp_row);
-} 
\ No newline at end of file
+/**
+ * Undo lifting_transform_1d exactly
+ */
+static void lifting_inverse_1d(int32_t *data, int size, int stride, int lanes, int32_t *temp) {
+    for (int length = 2; length <= size; length *= 2) {
+        int half = length / 2;
+
+        for (int i = 0; i < half; i++) {
+            const int32_t *low = data + i * stride;
+            const int32_t *high = data + (half + i) * stride;
+            int32_t *even = temp + 2 * i * lanes;
+            int32_t *odd = temp + (2 * i + 1) * lanes;
+
+            for (int l = 0; l < lanes; l++) {
+                odd[l] = low[l] - floor_half(high[l]);
+                even[l] = high[l] + odd[l];
+            }
+        }
+
+        for (int i = 0; i < length; i++) {
+            memcpy(data + i * stride, temp + i * lanes, lanes * sizeof(int32_t));
+        }
+    }
+}
+
+/**
+ * Apply the integer lifting G-let D3 forward transform to a tile of blocks
+ */
+void glet_d3_forward_int(int32_t *tile, int size, int lanes, int32_t *workspace) {
+    // Apply 1D transform to each row
+    for (int i = 0; i < size; i++) {
+        lifting_transform_1d(tile + i * size * lanes, size, lanes, lanes, workspace);
+    }
+
+    // Apply 1D transform to each column
+    for (int j = 0; j < size; j++) {
+        lifting_transform_1d(tile + j * lanes, size, size * lanes, lanes, workspace);
+    }
+}
+
+/**
+ * Apply the integer lifting G-let D3 inverse transform to a tile of blocks
+ */
+void glet_d3_inverse_int(int32_t *tile, int size, int lanes, int32_t *workspace) {
+    // Apply 1D inverse transform to each column
+    for (int j = 0; j < size; j++) {
+        lifting_inverse_1d(tile + j * lanes, size, size * lanes, lanes, workspace);
+    }
+
+    // Apply 1D inverse transform to each row
+    for (int i = 0; i < size; i++) {
+        lifting_inverse_1d(tile + i * size * lanes, size, lanes, lanes, workspace);
+    }
+}
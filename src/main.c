@@ -9,25 +9,109 @@ void print_usage(const char *program_name) {
     printf("G-let D3 PGM Steganography\n");
     printf("Usage:\n");
     printf("  %s embed <cover_image.pgm> <secret_image.pgm> <output_image.pgm> [options]\n", program_name);
-    printf("  %s extract <stego_image.pgm> <output_image.pgm> [width height] [options]\n", program_name);
-    printf("  %s assess <original_image.pgm> <modified_image.pgm>\n", program_name);
+    printf("  %s extract <stego_image.pgm> <output_image.pgm> [width height] [--roi x,y,w,h] [options]\n",
+           program_name);
+    printf("  %s assess <original_image.pgm> <modified_image.pgm> [--map <heatmap.pgm>] [--table <blocks.csv>]\n"
+           "         [-b <size>] [-j <threads>]\n", program_name);
+    printf("  %s batch <manifest.txt> <report.tsv> [options]\n", program_name);
+    printf("  %s detect <file_or_directory>... [-j <threads>]\n", program_name);
+    printf("  %s update <stego_image.pgm> <new_secret.pgm> [--old <old_secret.pgm>] [options]\n", program_name);
     printf("\nOptions:\n");
     printf("  embed   - Embed a secret image inside a cover image\n");
     printf("  extract - Extract a secret image from a stego image\n");
     printf("  assess  - Assess the quality difference between two images\n");
+    printf("  batch   - Run the embed/extract/assess jobs listed in a manifest, one per line\n");
+    printf("            (report '-' writes the report to stdout; --pipeline runs one job at a\n");
+    printf("            time on every worker, reading and writing the neighbouring jobs meanwhile)\n");
+    printf("  detect  - List the files carrying a payload (directories are scanned\n");
+    printf("            recursively), one line per file: path, secret width and height,\n");
+    printf("            block size, strength, block order and transform\n");
+    printf("  update  - Rewrite in place only the blocks of a stego image whose secret pixels\n");
+    printf("            changed (the layout comes from the stego header, so pass -seed for a\n");
+    printf("            random order; the new secret must match the embedded dimensions; for a\n");
+    printf("            lifting image, leaving out --old reads the current secret back)\n");
+    printf("  --map   - Also measure every embedding block (block size from the stego header,\n");
+    printf("            or -b) and write a heatmap of the block MSEs, the worst block white\n");
+    printf("  --table - Also write the per-block MSE, PSNR, SSIM and largest error as CSV\n");
+    printf("  --roi   - Extract only the w x h rectangle of the secret at (x, y), decoding\n");
+    printf("            only the blocks that carry it\n");
     printf("  width   - (Optional) Width of the secret image to extract\n");
     printf("  height  - (Optional) Height of the secret image to extract\n");
-    printf("\nAdvanced options (for embed/extract):\n");
+    printf("\nAdvanced options (for embed/extract, and defaults for batch jobs):\n");
     printf("  -b <size>      - Block size (must be power of 2, default: 8)\n");
     printf("  -s <strength>  - Embedding strength (1-10, default: 5)\n");
     printf("  -r             - Use random block selection (increases security)\n");
     printf("  -seed <value>  - Random seed value (default: current time)\n");
+    printf("  -l             - Use the integer lifting transform (exact round trip)\n");
+    printf("  -j <threads>   - Worker threads (0 = one per processor, default: 1;\n");
+    printf("                   batch: jobs run at once, default: one per processor)\n");
+    printf("  --stream       - Process the cover/stego image one block row at a time\n");
+}
+
+/**
+ * Print the configuration read back from a stego image's metadata block
+ */
+void print_detected_config(const StegoConfig *config) {
+    printf("Detected steganography configuration:\n");
+    printf("Block size: %d\n", config->block_size);
+    printf("Embedding strength: %d\n", config->embedding_strength);
+    printf("Using random blocks: %s\n", config->use_random_blocks ? "Yes" : "No");
+    printf("Transform: %s\n", config->transform == STEGO_TRANSFORM_LIFTING ? "Integer lifting" : "Haar");
+}
+
+/**
+ * Print the quality an embed reported for the blocks it rewrote
+ */
+void print_embed_report(const StegoEmbedReport *report) {
+    printf("Blocks changed: %lld, largest pixel change: %d\n",
+           (long long)report->blocks_changed, report->max_abs_error);
+    printf("PSNR of stego image: %.2f dB (higher is better, >30dB is good)\n", report->psnr);
+    printf("SSIM of stego image: %.4f (8x8 tiles; closer to 1 is better)\n", report->ssim);
+}
+
+/**
+ * Measure every embedding block and write the heatmap and table requested
+ * @return 0 on success, -1 on failure
+ */
+int write_block_quality(StegoContext *ctx, PGMImage *original, PGMImage *modified,
+                        const char *map_file, const char *table_file) {
+    int block_size, blocks_x, blocks_y;
+    StegoBlockQuality *blocks = ctx ? stego_context_block_quality(ctx, original, modified,
+                                                                  &block_size, &blocks_x, &blocks_y)
+                                    : NULL;
+    if (!blocks) return -1;
+
+    int status = 0;
+    if (map_file) {
+        PGMImage *heatmap = stego_block_quality_heatmap(blocks, blocks_x, blocks_y, block_size,
+                                                        original->width, original->height);
+        if (!heatmap || save_pgm(heatmap, map_file) != 0) {
+            printf("Error: Failed to write block heatmap: %s\n", map_file);
+            status = -1;
+        }
+        free_pgm(heatmap);
+    }
+
+    if (table_file && status == 0) {
+        FILE *table = fopen(table_file, "w");
+        if (!table || stego_block_quality_write_csv(blocks, blocks_x, blocks_y, block_size, table) != 0) {
+            printf("Error: Failed to write block table: %s\n", table_file);
+            status = -1;
+        }
+        if (table && fclose(table) != 0) status = -1;
+    }
+
+    if (status == 0) {
+        printf("Measured %d x %d blocks of %dx%d pixels\n", blocks_x, blocks_y, block_size, block_size);
+    }
+    free(blocks);
+    return status;
 }
 
 /**
  * Parse advanced options from command line
  */
-void parse_advanced_options(int argc, char *argv[], int start_idx, StegoConfig *config) {
+void parse_advanced_options(int argc, char *argv[], int start_idx, StegoConfig *config, int *streaming) {
     for (int i = start_idx; i < argc; i++) {
         if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
             config->block_size = atoi(argv[i + 1]);
@@ -49,12 +133,23 @@ void parse_advanced_options(int argc, char *argv[], int start_idx, StegoConfig *
             config->random_seed = atol(argv[i + 1]);
             i++; // Skip the next argument
         }
+        else if (strcmp(argv[i], "-l") == 0) {
+            config->transform = STEGO_TRANSFORM_LIFTING;
+        }
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            config->num_threads = atoi(argv[i + 1]);
+            if (config->num_threads < 0) config->num_threads = 1;
+            i++; // Skip the next argument
+        }
+        else if (strcmp(argv[i], "--stream") == 0) {
+            *streaming = 1;
+        }
     }
 }
 
 int main(int argc, char *argv[]) {
-    // Check command line arguments
-    if (argc < 4) {
+    // Check command line arguments (detect takes a single path)
+    if (argc < 3 || (argc < 4 && strcmp(argv[1], "detect") != 0)) {
         print_usage(argv[0]);
         return 1;
     }
@@ -76,24 +171,62 @@ int main(int argc, char *argv[]) {
 
         // Create configuration with default values
         StegoConfig config = create_default_config();
+        int streaming = 0;
         
         // Parse advanced options if provided
         if (argc > 5) {
-            parse_advanced_options(argc, argv, 5, &config);
+            parse_advanced_options(argc, argv, 5, &config, &streaming);
+        }
+
+        // The embed reports the quality of the blocks it rewrites, so
+        // neither image has to be read again afterwards
+        StegoEmbedReport report;
+        StegoContext *ctx = stego_context_create(&config);
+        if (!ctx) {
+            printf("Error: Failed to create steganography context\n");
+            return 1;
+        }
+        stego_context_set_embed_report(ctx, &report);
+
+        if (streaming) {
+            // Only the secret is loaded; the cover is read a strip at a time
+            PGMImage *secret = load_pgm_mapped(secret_file);
+            if (!secret) {
+                printf("Error: Failed to load secret image: %s\n", secret_file);
+                stego_context_destroy(ctx);
+                return 1;
+            }
+
+            printf("Streaming secret image (%dx%d) into cover image %s\n",
+                   secret->width, secret->height, cover_file);
+
+            int status = stego_context_embed_stream(ctx, cover_file, secret, output_file);
+            stego_context_destroy(ctx);
+            free_pgm(secret);
+            if (status != 0) {
+                printf("Error: Failed to embed secret image\n");
+                return 1;
+            }
+
+            print_embed_report(&report);
+            printf("Success: Secret image embedded and saved to %s\n", output_file);
+            return 0;
         }
 
         // Load cover image
-        PGMImage *cover = load_pgm(cover_file);
+        PGMImage *cover = load_pgm_mapped(cover_file);
         if (!cover) {
             printf("Error: Failed to load cover image: %s\n", cover_file);
+            stego_context_destroy(ctx);
             return 1;
         }
 
         // Load secret image
-        PGMImage *secret = load_pgm(secret_file);
+        PGMImage *secret = load_pgm_mapped(secret_file);
         if (!secret) {
             printf("Error: Failed to load secret image: %s\n", secret_file);
             free_pgm(cover);
+            stego_context_destroy(ctx);
             return 1;
         }
 
@@ -103,41 +236,24 @@ int main(int argc, char *argv[]) {
         printf("  Block size: %d\n", config.block_size);
         printf("  Embedding strength: %d\n", config.embedding_strength);
         printf("  Random blocks: %s\n", config.use_random_blocks ? "Yes" : "No");
+        printf("  Transform: %s\n", config.transform == STEGO_TRANSFORM_LIFTING ? "Integer lifting" : "Haar");
         if (config.use_random_blocks) {
             printf("  Random seed: %lu\n", config.random_seed);
         }
 
-        // Embed secret image into cover image
-        PGMImage *stego = embed_image_with_config(cover, secret, &config);
-        if (!stego) {
+        // Embed secret image into cover image, straight into the output file
+        int status = stego_context_embed_file(ctx, cover, secret, output_file);
+        stego_context_destroy(ctx);
+        free_pgm(cover);
+        free_pgm(secret);
+        if (status != 0) {
             printf("Error: Failed to embed secret image\n");
-            free_pgm(cover);
-            free_pgm(secret);
-            return 1;
-        }
-
-        // Calculate and display PSNR to assess quality
-        double psnr = calculate_psnr(cover, stego);
-        double ssim = calculate_ssim(cover, stego);
-        printf("PSNR of stego image: %.2f dB (higher is better, >30dB is good)\n", psnr);
-        printf("SSIM of stego image: %.4f (closer to 1 is better)\n", ssim);
-
-        // Save stego image
-        if (save_pgm(stego, output_file) != 0) {
-            printf("Error: Failed to save stego image: %s\n", output_file);
-            free_pgm(cover);
-            free_pgm(secret);
-            free_pgm(stego);
             return 1;
         }
 
+        print_embed_report(&report);
         printf("Success: Secret image embedded and saved to %s\n", output_file);
 
-        // Free memory
-        free_pgm(cover);
-        free_pgm(secret);
-        free_pgm(stego);
-
     } else if (strcmp(operation, "extract") == 0) {
         // Extraction operation
         if (argc < 4) {
@@ -167,14 +283,45 @@ int main(int argc, char *argv[]) {
 
         // Create configuration with default values
         StegoConfig config = create_default_config();
+        int streaming = 0;
         
         // Parse advanced options if provided
         if (argc > option_start_idx) {
-            parse_advanced_options(argc, argv, option_start_idx, &config);
+            parse_advanced_options(argc, argv, option_start_idx, &config, &streaming);
+        }
+
+        // A region is read through the mapping, which pages in only its blocks
+        StegoRegion region;
+        int use_region = 0;
+        for (int i = option_start_idx; i < argc; i++) {
+            if (strcmp(argv[i], "--roi") != 0) continue;
+
+            if (i + 1 >= argc || sscanf(argv[i + 1], "%d,%d,%d,%d", &region.x, &region.y,
+                                        &region.width, &region.height) != 4) {
+                printf("Error: --roi expects x,y,width,height\n");
+                return 1;
+            }
+            use_region = 1;
+            streaming = 0;
+        }
+
+        if (streaming) {
+            printf("Streaming secret image out of %s\n", stego_file);
+
+            int detect = width <= 0 || height <= 0;
+            if (extract_image_stream(stego_file, output_file, &width, &height, &config) != 0) {
+                printf("Error: Failed to extract secret image\n");
+                return 1;
+            }
+
+            if (detect) print_detected_config(&config);
+            printf("Extracted secret image dimensions: %dx%d\n", width, height);
+            printf("Success: Secret image extracted and saved to %s\n", output_file);
+            return 0;
         }
 
         // Load stego image
-        PGMImage *stego = load_pgm(stego_file);
+        PGMImage *stego = load_pgm_mapped(stego_file);
         if (!stego) {
             printf("Error: Failed to load stego image: %s\n", stego_file);
             return 1;
@@ -188,19 +335,26 @@ int main(int argc, char *argv[]) {
         printf("  Block size: %d\n", config.block_size);
         printf("  Embedding strength: %d\n", config.embedding_strength);
         printf("  Random blocks: %s\n", config.use_random_blocks ? "Yes" : "No");
+        printf("  Transform: %s\n", config.transform == STEGO_TRANSFORM_LIFTING ? "Integer lifting" : "Haar");
         if (config.use_random_blocks) {
             printf("  Random seed: %lu\n", config.random_seed);
         }
 
-        // Extract secret image
-        PGMImage *secret = extract_image_with_config(stego, width, height, &config);
+        // Extract secret image, or the requested region of it
+        if (use_region) {
+            printf("Extracting region %dx%d at (%d, %d)\n", region.width, region.height, region.x, region.y);
+        }
+        PGMImage *secret = use_region ? extract_region_with_config(stego, width, height, &region, &config)
+                                      : extract_image_with_config(stego, width, height, &config);
         if (!secret) {
             printf("Error: Failed to extract secret image\n");
             free_pgm(stego);
             return 1;
         }
 
-        printf("Extracted secret image dimensions: %dx%d\n", secret->width, secret->height);
+        if (width <= 0 || height <= 0) print_detected_config(&config);
+        printf("Extracted %s dimensions: %dx%d\n", use_region ? "region" : "secret image",
+               secret->width, secret->height);
 
         // Save secret image
         if (save_pgm(secret, output_file) != 0) {
@@ -218,7 +372,7 @@ int main(int argc, char *argv[]) {
 
     } else if (strcmp(operation, "assess") == 0) {
         // Quality assessment operation
-        if (argc != 4) {
+        if (argc < 4) {
             printf("Error: Assessment requires 2 file arguments\n");
             print_usage(argv[0]);
             return 1;
@@ -226,32 +380,77 @@ int main(int argc, char *argv[]) {
 
         const char *original_file = argv[2];
         const char *modified_file = argv[3];
+        const char *map_file = NULL;
+        const char *table_file = NULL;
+        for (int i = 4; i + 1 < argc; i++) {
+            if (strcmp(argv[i], "--map") == 0) {
+                map_file = argv[++i];
+            } else if (strcmp(argv[i], "--table") == 0) {
+                table_file = argv[++i];
+            }
+        }
 
         // Load original image
-        PGMImage *original = load_pgm(original_file);
+        PGMImage *original = load_pgm_mapped(original_file);
         if (!original) {
             printf("Error: Failed to load original image: %s\n", original_file);
             return 1;
         }
 
         // Load modified image
-        PGMImage *modified = load_pgm(modified_file);
+        PGMImage *modified = load_pgm_mapped(modified_file);
         if (!modified) {
             printf("Error: Failed to load modified image: %s\n", modified_file);
             free_pgm(original);
             return 1;
         }
 
-        // Calculate and display quality metrics
-        double mse = calculate_mse(original, modified);
-        double psnr = calculate_psnr(original, modified);
-        double ssim = calculate_ssim(original, modified);
+        // Only -j applies to the metrics; the block grid follows the stego
+        // header unless -b overrides it
+        StegoConfig config = create_default_config();
+        StegoHeader header;
+        PGMImageView modified_view = pgm_image_view(modified);
+        if (stego_header_read(&modified_view, &header) == 0) config.block_size = header.block_size;
+        int streaming = 0;
+        parse_advanced_options(argc, argv, 4, &config, &streaming);
+
+        // Calculate every metric in one pass over the images, then MS-SSIM over their pyramids
+        StegoQualityMetrics metrics;
+        StegoContext *ctx = stego_context_create(&config);
+        int status = ctx ? stego_context_quality_metrics(ctx, original, modified, &metrics)
+                         : compute_quality_metrics(original, modified, &metrics);
+        double ms_ssim = ctx ? stego_context_ms_ssim(ctx, original, modified) : calculate_ms_ssim(original, modified);
+        if (ms_ssim < 0.0) status = -1;
+        if (status == 0 && (map_file || table_file)) {
+            status = write_block_quality(ctx, original, modified, map_file, table_file);
+        }
+        stego_context_destroy(ctx);
+        if (status != 0) {
+            printf("Error: Failed to assess %s against %s\n", modified_file, original_file);
+            free_pgm(original);
+            free_pgm(modified);
+            return 1;
+        }
 
         printf("\nQuality Assessment Results:\n");
         printf("-------------------------\n");
-        printf("Mean Square Error (MSE): %.4f (lower is better)\n", mse);
-        printf("Peak Signal-to-Noise Ratio (PSNR): %.2f dB (higher is better)\n", psnr);
-        printf("Structural Similarity Index (SSIM): %.4f (closer to 1 is better)\n", ssim);
+        printf("Mean Square Error (MSE): %.4f (lower is better)\n", metrics.mse);
+        printf("Peak Signal-to-Noise Ratio (PSNR): %.2f dB (higher is better)\n", metrics.psnr);
+        printf("Structural Similarity Index (SSIM): %.4f (closer to 1 is better)\n", metrics.ssim);
+        printf("Multi-scale SSIM (MS-SSIM): %.4f (closer to 1 is better)\n", ms_ssim);
+        printf("Maximum absolute error: %d\n", metrics.max_abs_error);
+
+        // Pixel counts of the smaller differences, then everything above
+        printf("Absolute error histogram:\n");
+        uint64_t above = 0;
+        for (int k = 0; k < 256; k++) {
+            if (k <= 8) {
+                printf("  %3d: %llu\n", k, (unsigned long long)metrics.histogram[k]);
+            } else {
+                above += metrics.histogram[k];
+            }
+        }
+        printf("   >8: %llu\n", (unsigned long long)above);
         printf("\nInterpretation:\n");
         printf("- PSNR > 30 dB: Good quality\n");
         printf("- PSNR > 40 dB: Excellent quality\n");
@@ -262,6 +461,117 @@ int main(int argc, char *argv[]) {
         free_pgm(original);
         free_pgm(modified);
 
+    } else if (strcmp(operation, "batch") == 0) {
+        // Batch operation
+        const char *manifest_file = argv[2];
+        const char *report_file = argv[3];
+
+        // Jobs run side by side, one per processor unless -j says otherwise
+        StegoConfig config = create_default_config();
+        config.num_threads = 0;
+        int streaming = 0;
+        int pipelined = 0;
+        if (argc > 4) {
+            parse_advanced_options(argc, argv, 4, &config, &streaming);
+        }
+        for (int i = 4; i < argc; i++) {
+            if (strcmp(argv[i], "--pipeline") == 0) pipelined = 1;
+        }
+
+        FILE *report = strcmp(report_file, "-") == 0 ? stdout : fopen(report_file, "w");
+        if (!report) {
+            printf("Error: Cannot open report file %s\n", report_file);
+            return 1;
+        }
+
+        int failed = pipelined ? stego_batch_pipeline(manifest_file, report, &config, config.num_threads)
+                               : stego_batch_run(manifest_file, report, &config, config.num_threads);
+        if (report != stdout && fclose(report) != 0) {
+            printf("Error: Failed to write report file %s\n", report_file);
+            return 1;
+        }
+
+        if (failed < 0) {
+            printf("Error: Failed to run batch %s\n", manifest_file);
+            return 1;
+        }
+
+        if (report != stdout) {
+            printf("Batch finished: %d job(s) failed, report saved to %s\n", failed, report_file);
+        }
+        return failed > 0 ? 2 : 0;
+
+    } else if (strcmp(operation, "detect") == 0) {
+        // Detection operation: every argument but -j and its value is a path
+        const char **paths = (const char **)malloc((argc - 2) * sizeof(const char *));
+        if (!paths) return 1;
+
+        int num_paths = 0;
+        int num_threads = 0;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+                num_threads = atoi(argv[++i]);
+                if (num_threads < 0) num_threads = 1;
+            } else {
+                paths[num_paths++] = argv[i];
+            }
+        }
+
+        int scanned = 0;
+        int found = stego_detect_scan(paths, num_paths, stdout, num_threads, &scanned);
+        free(paths);
+        if (found < 0) {
+            printf("Error: Failed to scan for payloads\n");
+            return 1;
+        }
+
+        // The summary goes to stderr so that stdout stays one line per file
+        fprintf(stderr, "Scanned %d file(s), %d carry a payload\n", scanned, found);
+        return found > 0 ? 0 : 2;
+
+    } else if (strcmp(operation, "update") == 0) {
+        // Update operation
+        const char *stego_file = argv[2];
+        const char *secret_file = argv[3];
+
+        StegoConfig config = create_default_config();
+        int streaming = 0;
+        const char *old_file = NULL;
+        if (argc > 4) {
+            parse_advanced_options(argc, argv, 4, &config, &streaming);
+        }
+        for (int i = 4; i + 1 < argc; i++) {
+            if (strcmp(argv[i], "--old") == 0) old_file = argv[i + 1];
+        }
+
+        PGMImage *secret = load_pgm(secret_file);
+        if (!secret) {
+            printf("Error: Failed to load secret image: %s\n", secret_file);
+            return 1;
+        }
+
+        PGMImage *old_secret = NULL;
+        if (old_file) {
+            old_secret = load_pgm(old_file);
+            if (!old_secret) {
+                printf("Error: Failed to load old secret image: %s\n", old_file);
+                free_pgm(secret);
+                return 1;
+            }
+        }
+
+        printf("Updating secret image in %s\n", stego_file);
+        int64_t blocks = update_image_file(stego_file, old_secret, secret, &config);
+        free_pgm(secret);
+        free_pgm(old_secret);
+
+        if (blocks < 0) {
+            printf("Error: Failed to update stego image\n");
+            return 1;
+        }
+
+        printf("Success: Rewrote %lld block(s) of %s\n", (long long)blocks, stego_file);
+
     } else {
         printf("Error: Unknown operation '%s'\n", operation);
         print_usage(argv[0]);
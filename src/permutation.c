@@ -0,0 +1,110 @@
+/**
+ * permutation.c
+ * Keyed pseudorandom permutation of block indices
+ *
+ * A Feistel network permutes the smallest power-of-two bit domain that
+ * covers [0, size). Values that land outside the range are fed through the
+ * network again (cycle walking) until they fall inside, which keeps the map
+ * a bijection on [0, size) itself. Since the covering domain is less than
+ * twice the range, a lookup takes under two network passes on average.
+ */
+
+#include "../include/steganography.h"
+
+/**
+ * splitmix64 finalizer, used to derive the round keys
+ */
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/**
+ * Initialize a permutation of [0, size) keyed by a seed
+ */
+void stego_permutation_init(StegoPermutation *perm, uint64_t size, unsigned long seed) {
+    int bits = 2;
+    while (bits < 64 && (1ULL << bits) < size) {
+        bits++;
+    }
+
+    perm->size = size;
+    perm->high_bits = bits / 2;
+    perm->low_bits = bits - perm->high_bits;
+    perm->low_mask = (1ULL << perm->low_bits) - 1;
+
+    uint64_t state = (uint64_t)seed;
+    for (int round = 0; round < STEGO_PERMUTATION_ROUNDS; round++) {
+        state += 0x9E3779B97F4A7C15ULL;
+        perm->keys[round] = mix64(state);
+    }
+}
+
+/**
+ * Feistel round function: a keyed multiply whose well-mixed top `bits` bits
+ * form the output
+ */
+static uint64_t round_function(uint64_t half, uint64_t key, int bits) {
+    uint64_t x = (half ^ key) * 0xD6E8FEB86659FD93ULL;
+    x ^= x >> 32;
+    x *= 0xD6E8FEB86659FD93ULL;
+    return x >> (64 - bits);
+}
+
+/**
+ * One pass of the Feistel network over the covering bit domain. The two
+ * halves may differ in width by one bit, so instead of swapping them each
+ * round alternately updates the high and the low half from the other.
+ */
+static uint64_t feistel_forward(const StegoPermutation *perm, uint64_t x) {
+    uint64_t high = x >> perm->low_bits;
+    uint64_t low = x & perm->low_mask;
+
+    for (int round = 0; round < STEGO_PERMUTATION_ROUNDS; round += 2) {
+        high ^= round_function(low, perm->keys[round], perm->high_bits);
+        low ^= round_function(high, perm->keys[round + 1], perm->low_bits);
+    }
+
+    return (high << perm->low_bits) | low;
+}
+
+/**
+ * Undo one pass of the Feistel network
+ */
+static uint64_t feistel_inverse(const StegoPermutation *perm, uint64_t x) {
+    uint64_t high = x >> perm->low_bits;
+    uint64_t low = x & perm->low_mask;
+
+    for (int round = STEGO_PERMUTATION_ROUNDS - 2; round >= 0; round -= 2) {
+        low ^= round_function(high, perm->keys[round + 1], perm->low_bits);
+        high ^= round_function(low, perm->keys[round], perm->high_bits);
+    }
+
+    return (high << perm->low_bits) | low;
+}
+
+/**
+ * Map an index in [0, size) to its position in the permutation
+ */
+uint64_t stego_permutation_apply(const StegoPermutation *perm, uint64_t index) {
+    do {
+        index = feistel_forward(perm, index);
+    } while (index >= perm->size);
+
+    return index;
+}
+
+/**
+ * Map a permuted position back to the index it came from
+ */
+uint64_t stego_permutation_invert(const StegoPermutation *perm, uint64_t value) {
+    do {
+        value = feistel_inverse(perm, value);
+    } while (value >= perm->size);
+
+    return value;
+}
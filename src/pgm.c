@@ -3,39 +3,32 @@
  * Implementation of PGM image handling functions
  */
 
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE // madvise hints beyond POSIX
+
 #include "../include/steganography.h"
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 /**
- * Load a PGM image from a file
+ * Parse a binary PGM header, leaving the file positioned at the first pixel
  */
-PGMImage* load_pgm(const char *filename) {
-    FILE *file = fopen(filename, "rb");
-    if (!file) {
-        fprintf(stderr, "Error: Cannot open file %s\n", filename);
-        return NULL;
-    }
-
-    // Allocate memory for the image
-    PGMImage *img = (PGMImage *)malloc(sizeof(PGMImage));
-    if (!img) {
-        fclose(file);
-        return NULL;
-    }
-
+int read_pgm_header(FILE *file, int *width, int *height, int *max_gray) {
     // Read magic number
     char magic[3];
     if (fscanf(file, "%2s", magic) != 1) {
         fprintf(stderr, "Error: Failed to read magic number\n");
-        fclose(file);
-        free(img);
-        return NULL;
+        return -1;
     }
 
     if (strcmp(magic, "P5") != 0) {
         fprintf(stderr, "Error: Not a valid PGM file (P5 format expected)\n");
-        fclose(file);
-        free(img);
-        return NULL;
+        return -1;
     }
 
     // Skip comments and whitespace
@@ -51,41 +44,119 @@ PGMImage* load_pgm(const char *filename) {
     ungetc(c, file);
 
     // Read width and height
-    if (fscanf(file, "%d %d", &img->width, &img->height) != 2) {
+    if (fscanf(file, "%d %d", width, height) != 2) {
         fprintf(stderr, "Error: Failed to read width and height\n");
-        fclose(file);
-        free(img);
-        return NULL;
+        return -1;
     }
 
-    printf("Read image dimensions: %dx%d\n", img->width, img->height);
+    if (*width <= 0 || *height <= 0) {
+        fprintf(stderr, "Error: Invalid image dimensions %dx%d\n", *width, *height);
+        return -1;
+    }
 
     // Skip any whitespace
     while ((c = fgetc(file)) != EOF && (c == ' ' || c == '\t' || c == '\n' || c == '\r'));
     ungetc(c, file);
 
     // Read max gray value
-    if (fscanf(file, "%d", &img->max_gray) != 1) {
+    if (fscanf(file, "%d", max_gray) != 1) {
         fprintf(stderr, "Error: Failed to read max gray value\n");
-        fclose(file);
-        free(img);
-        return NULL;
+        return -1;
     }
 
-    printf("Read max gray value: %d\n", img->max_gray);
-    
     // Skip whitespace until we reach the binary data
     // There should be exactly one whitespace character (newline, space, etc.) after max_gray value
     c = fgetc(file);
     if (c == EOF || !(c == ' ' || c == '\t' || c == '\n' || c == '\r')) {
         fprintf(stderr, "Error: Missing whitespace after max gray value\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Format a binary PGM header into a buffer
+ */
+int format_pgm_header(char *buffer, size_t size, int width, int height, int max_gray) {
+    int length = snprintf(buffer, size, "P5\n# Created by G-let D3 Steganography\n%d %d\n%d\n",
+                          width, height, max_gray);
+    return length < 0 || (size_t)length >= size ? -1 : length;
+}
+
+/**
+ * Write a binary PGM header
+ */
+int write_pgm_header(FILE *file, int width, int height, int max_gray) {
+    char header[PGM_HEADER_MAX];
+    int length = format_pgm_header(header, sizeof(header), width, height, max_gray);
+    if (length < 0) return -1;
+
+    return fwrite(header, 1, length, file) == (size_t)length ? 0 : -1;
+}
+
+/**
+ * Alignment of every pixel buffer (one cache line)
+ */
+#define PGM_PIXEL_ALIGNMENT 64
+
+/**
+ * Transparent huge page size; buffers spanning several of them are aligned
+ * to it so the kernel can back them with huge pages
+ */
+#define PGM_HUGE_PAGE_SIZE ((size_t)2 << 20)
+
+/**
+ * Allocate a pixel buffer, 64-byte aligned and huge-page backed when large
+ */
+unsigned char* pgm_alloc_pixels(size_t count) {
+    if (count == 0) count = 1;
+
+#ifdef _WIN32
+    return (unsigned char *)malloc(count);
+#else
+    size_t alignment = count >= 4 * PGM_HUGE_PAGE_SIZE ? PGM_HUGE_PAGE_SIZE : PGM_PIXEL_ALIGNMENT;
+    void *pixels = NULL;
+    if (posix_memalign(&pixels, alignment, count) != 0) return NULL;
+
+#ifdef MADV_HUGEPAGE
+    // Only a hint: without THP support the buffer simply uses normal pages
+    if (alignment == PGM_HUGE_PAGE_SIZE) {
+        madvise(pixels, count, MADV_HUGEPAGE);
+    }
+#endif
+
+    return (unsigned char *)pixels;
+#endif
+}
+
+/**
+ * Load a PGM image from a file
+ */
+PGMImage* load_pgm(const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open file %s\n", filename);
+        return NULL;
+    }
+
+    // Allocate memory for the image
+    PGMImage *img = (PGMImage *)calloc(1, sizeof(PGMImage));
+    if (!img) {
+        fclose(file);
+        return NULL;
+    }
+
+    // Parse the header up to the first pixel byte
+    if (read_pgm_header(file, &img->width, &img->height, &img->max_gray) != 0) {
         fclose(file);
         free(img);
         return NULL;
     }
 
     // Allocate memory for the image data
-    img->data = (unsigned char *)malloc(img->width * img->height * sizeof(unsigned char));
+    size_t pixels = (size_t)img->width * img->height;
+    img->data = pgm_alloc_pixels(pixels);
     if (!img->data) {
         fprintf(stderr, "Error: Failed to allocate memory for image data\n");
         fclose(file);
@@ -94,10 +165,10 @@ PGMImage* load_pgm(const char *filename) {
     }
 
     // Read the image data
-    size_t bytes_read = fread(img->data, sizeof(unsigned char), img->width * img->height, file);
-    if (bytes_read != img->width * img->height) {
-        fprintf(stderr, "Error: Failed to read image data. Expected %d bytes, got %zu bytes\n", 
-                img->width * img->height, bytes_read);
+    size_t bytes_read = fread(img->data, sizeof(unsigned char), pixels, file);
+    if (bytes_read != pixels) {
+        fprintf(stderr, "Error: Failed to read image data. Expected %zu bytes, got %zu bytes\n", 
+                pixels, bytes_read);
         fclose(file);
         free(img->data);
         free(img);
@@ -105,10 +176,177 @@ PGMImage* load_pgm(const char *filename) {
     }
 
     fclose(file);
-    printf("Successfully loaded PGM image: %s (%dx%d)\n", filename, img->width, img->height);
     return img;
 }
 
+#ifndef _WIN32
+
+/**
+ * Skip whitespace and comment lines in a header held in memory
+ */
+static size_t skip_header_space(const unsigned char *buf, size_t size, size_t pos) {
+    while (pos < size && (buf[pos] == ' ' || buf[pos] == '\t' || buf[pos] == '\n' || buf[pos] == '\r' || buf[pos] == '#')) {
+        if (buf[pos] == '#') {
+            // Skip the entire comment line
+            while (pos < size && buf[pos] != '\n') pos++;
+        }
+        pos++;
+    }
+    return pos;
+}
+
+/**
+ * Parse a non-negative decimal header field held in memory
+ */
+static int parse_header_int(const unsigned char *buf, size_t size, size_t *pos, int *value) {
+    size_t p = *pos;
+    long v = 0;
+
+    if (p >= size || buf[p] < '0' || buf[p] > '9') return -1;
+    while (p < size && buf[p] >= '0' && buf[p] <= '9') {
+        v = v * 10 + (buf[p++] - '0');
+        if (v > 0x7FFFFFFFL) return -1;
+    }
+
+    *value = (int)v;
+    *pos = p;
+    return 0;
+}
+
+/**
+ * Parse a binary PGM header at the start of a mapping
+ * @param offset Receives the offset of the first pixel byte
+ */
+static int parse_pgm_header(const unsigned char *buf, size_t size, int *width, int *height,
+                            int *max_gray, size_t *offset) {
+    if (size < 2 || buf[0] != 'P' || buf[1] != '5') {
+        fprintf(stderr, "Error: Not a valid PGM file (P5 format expected)\n");
+        return -1;
+    }
+
+    size_t pos = skip_header_space(buf, size, 2);
+    int status = parse_header_int(buf, size, &pos, width);
+    if (status == 0) {
+        pos = skip_header_space(buf, size, pos);
+        status = parse_header_int(buf, size, &pos, height);
+    }
+    if (status != 0) {
+        fprintf(stderr, "Error: Failed to read width and height\n");
+        return -1;
+    }
+
+    if (*width <= 0 || *height <= 0) {
+        fprintf(stderr, "Error: Invalid image dimensions %dx%d\n", *width, *height);
+        return -1;
+    }
+
+    pos = skip_header_space(buf, size, pos);
+    if (parse_header_int(buf, size, &pos, max_gray) != 0) {
+        fprintf(stderr, "Error: Failed to read max gray value\n");
+        return -1;
+    }
+
+    // Exactly one whitespace character separates the header from the pixels
+    if (pos >= size || !(buf[pos] == ' ' || buf[pos] == '\t' || buf[pos] == '\n' || buf[pos] == '\r')) {
+        fprintf(stderr, "Error: Missing whitespace after max gray value\n");
+        return -1;
+    }
+
+    *offset = pos + 1;
+    return 0;
+}
+
+#endif /* _WIN32 */
+
+/**
+ * Map a PGM image into memory; data points at the pixel bytes of the mapping
+ */
+PGMImage* load_pgm_mapped(const char *filename) {
+#ifdef _WIN32
+    return load_pgm(filename);
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot open file %s\n", filename);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        fprintf(stderr, "Error: Cannot read size of file %s\n", filename);
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // The mapping keeps the file referenced
+
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "Error: Cannot map file %s\n", filename);
+        return NULL;
+    }
+
+    PGMImage *img = (PGMImage *)calloc(1, sizeof(PGMImage));
+    if (!img) {
+        munmap(mapping, size);
+        return NULL;
+    }
+
+    size_t offset;
+    if (parse_pgm_header((const unsigned char *)mapping, size, &img->width, &img->height,
+                         &img->max_gray, &offset) != 0) {
+        munmap(mapping, size);
+        free(img);
+        return NULL;
+    }
+
+    size_t pixels = (size_t)img->width * img->height;
+    if (size - offset < pixels) {
+        fprintf(stderr, "Error: Failed to read image data. Expected %zu bytes, got %zu bytes\n",
+                pixels, size - offset);
+        munmap(mapping, size);
+        free(img);
+        return NULL;
+    }
+
+    // Callers walk the pixels front to back; let the kernel read ahead
+    posix_madvise(mapping, size, POSIX_MADV_SEQUENTIAL);
+
+    img->data = (unsigned char *)mapping + offset;
+    img->mapping = mapping;
+    img->mapping_size = size;
+
+    return img;
+#endif
+}
+
+/**
+ * View of a whole PGM image
+ */
+PGMImageView pgm_image_view(PGMImage *img) {
+    PGMImageView view = { img->data, img->width, img->height, (size_t)img->width };
+    return view;
+}
+
+/**
+ * View of a sub-rectangle of another view, clipped to it
+ */
+PGMImageView pgm_subview(const PGMImageView *view, int x, int y, int width, int height) {
+    PGMImageView sub = { view->data, 0, 0, view->stride };
+
+    if (x < 0) { width += x; x = 0; }
+    if (y < 0) { height += y; y = 0; }
+    if (width > view->width - x) width = view->width - x;
+    if (height > view->height - y) height = view->height - y;
+    if (width <= 0 || height <= 0) return sub;
+
+    sub.data = view->data + (size_t)y * view->stride + x;
+    sub.width = width;
+    sub.height = height;
+    return sub;
+}
+
 /**
  * Save a PGM image to a file
  */
@@ -125,22 +363,27 @@ int save_pgm(PGMImage *img, const char *filename) {
     }
 
     // Write header
-    fprintf(file, "P5\n");
-    fprintf(file, "# Created by G-let D3 Steganography\n");
-    fprintf(file, "%d %d\n", img->width, img->height);
-    fprintf(file, "%d\n", img->max_gray);
+    if (write_pgm_header(file, img->width, img->height, img->max_gray) != 0) {
+        fprintf(stderr, "Error: Failed to write PGM header to %s\n", filename);
+        fclose(file);
+        return -1;
+    }
 
     // Write image data
-    size_t bytes_written = fwrite(img->data, sizeof(unsigned char), img->width * img->height, file);
-    if (bytes_written != img->width * img->height) {
-        fprintf(stderr, "Error: Failed to write image data. Expected %d bytes, wrote %zu bytes\n", 
-                img->width * img->height, bytes_written);
+    size_t pixels = (size_t)img->width * img->height;
+    size_t bytes_written = fwrite(img->data, sizeof(unsigned char), pixels, file);
+    if (bytes_written != pixels) {
+        fprintf(stderr, "Error: Failed to write image data. Expected %zu bytes, wrote %zu bytes\n", 
+                pixels, bytes_written);
         fclose(file);
         return -1;
     }
 
-    fclose(file);
-    printf("Successfully saved PGM image: %s (%dx%d)\n", filename, img->width, img->height);
+    // Buffered writes fail here
+    if (fclose(file) != 0) {
+        fprintf(stderr, "Error: Failed to write %s\n", filename);
+        return -1;
+    }
     return 0;
 }
 
@@ -149,6 +392,13 @@ int save_pgm(PGMImage *img, const char *filename) {
  */
 void free_pgm(PGMImage *img) {
     if (img) {
+#ifndef _WIN32
+        // Mapped pixels belong to the mapping, not to the heap
+        if (img->mapping) {
+            munmap(img->mapping, img->mapping_size);
+            img->data = NULL;
+        }
+#endif
         if (img->data) {
             free(img->data);
         }
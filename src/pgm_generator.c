@@ -24,7 +24,7 @@ void generate_gradient(const char *filename, int width, int height) {
     fprintf(file, "255\n");
 
     // Write image data - horizontal gradient
-    unsigned char *data = (unsigned char *)malloc(width * height);
+    unsigned char *data = (unsigned char *)malloc((size_t)width * height);
     if (!data) {
         fclose(file);
         return;
@@ -33,11 +33,11 @@ void generate_gradient(const char *filename, int width, int height) {
     for (int y = 0; y < height; y++) {
         for (int x = 0; x < width; x++) {
             // Create a gradient from 0 to 255
-            data[y * width + x] = (unsigned char)(255.0 * x / width);
+            data[(size_t)y * width + x] = (unsigned char)(255.0 * x / width);
         }
     }
 
-    fwrite(data, 1, width * height, file);
+    fwrite(data, 1, (size_t)width * height, file);
     fclose(file);
     free(data);
     printf("Generated gradient image: %s (%dx%d)\n", filename, width, height);
@@ -57,7 +57,7 @@ void generate_checkerboard(const char *filename, int width, int height, int squa
     fprintf(file, "255\n");
 
     // Write image data - checkerboard pattern
-    unsigned char *data = (unsigned char *)malloc(width * height);
+    unsigned char *data = (unsigned char *)malloc((size_t)width * height);
     if (!data) {
         fclose(file);
         return;
@@ -69,14 +69,14 @@ void generate_checkerboard(const char *filename, int width, int height, int squa
             int square_x = x / square_size;
             int square_y = y / square_size;
             if ((square_x + square_y) % 2 == 0) {
-                data[y * width + x] = 0;    // Black
+                data[(size_t)y * width + x] = 0;    // Black
             } else {
-                data[y * width + x] = 255;  // White
+                data[(size_t)y * width + x] = 255;  // White
             }
         }
     }
 
-    fwrite(data, 1, width * height, file);
+    fwrite(data, 1, (size_t)width * height, file);
     fclose(file);
     free(data);
     printf("Generated checkerboard image: %s (%dx%d, square size: %d)\n", 
@@ -100,7 +100,7 @@ void generate_noise(const char *filename, int width, int height) {
     fprintf(file, "255\n");
 
     // Write image data - random noise
-    unsigned char *data = (unsigned char *)malloc(width * height);
+    unsigned char *data = (unsigned char *)malloc((size_t)width * height);
     if (!data) {
         fclose(file);
         return;
@@ -109,11 +109,11 @@ void generate_noise(const char *filename, int width, int height) {
     for (int y = 0; y < height; y++) {
         for (int x = 0; x < width; x++) {
             // Generate random grayscale value
-            data[y * width + x] = (unsigned char)(rand() % 256);
+            data[(size_t)y * width + x] = (unsigned char)(rand() % 256);
         }
     }
 
-    fwrite(data, 1, width * height, file);
+    fwrite(data, 1, (size_t)width * height, file);
     fclose(file);
     free(data);
     printf("Generated noise image: %s (%dx%d)\n", filename, width, height);
@@ -133,14 +133,14 @@ void generate_text(const char *filename, int width, int height, const char *text
     fprintf(file, "255\n");
 
     // Write image data - white background
-    unsigned char *data = (unsigned char *)malloc(width * height);
+    unsigned char *data = (unsigned char *)malloc((size_t)width * height);
     if (!data) {
         fclose(file);
         return;
     }
     
     // Initialize with white background
-    memset(data, 255, width * height);
+    memset(data, 255, (size_t)width * height);
 
     // A very simple "font" - just draw the text as black pixels
     int text_len = strlen(text);
@@ -170,7 +170,7 @@ void generate_text(const char *filename, int width, int height, const char *text
                             y == char_height/2 ||
                             (y == 0 && x >= char_width/3 && x <= 2*char_width/3)) {
                             if (char_start_x + x < width && start_y + y < height) {
-                                data[(start_y + y) * width + (char_start_x + x)] = 0;
+                                data[(size_t)(start_y + y) * width + (char_start_x + x)] = 0;
                             }
                         }
                     }
@@ -182,7 +182,7 @@ void generate_text(const char *filename, int width, int height, const char *text
                     for (int x = 0; x < char_width; x++) {
                         if (y == 0 || y == char_height-1 || x == 0 || x == char_width-1) {
                             if (char_start_x + x < width && start_y + y < height) {
-                                data[(start_y + y) * width + (char_start_x + x)] = 0;
+                                data[(size_t)(start_y + y) * width + (char_start_x + x)] = 0;
                             }
                         }
                     }
@@ -191,7 +191,7 @@ void generate_text(const char *filename, int width, int height, const char *text
         }
     }
 
-    fwrite(data, 1, width * height, file);
+    fwrite(data, 1, (size_t)width * height, file);
     fclose(file);
     free(data);
     printf("Generated text image: %s (%dx%d, text: \"%s\")\n", 
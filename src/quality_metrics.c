@@ -3,7 +3,11 @@
  * Implementation of image quality metrics for steganography
  */
 
-#include "../include/steganography.h"
+#include "stego_internal.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 /**
  * Calculate the Mean Square Error between two images
@@ -21,10 +25,10 @@ double calculate_mse(PGMImage *img1, PGMImage *img2) {
     }
 
     double sum = 0.0;
-    int pixel_count = img1->width * img1->height;
+    size_t pixel_count = (size_t)img1->width * img1->height;
 
     // Calculate sum of squared differences
-    for (int i = 0; i < pixel_count; i++) {
+    for (size_t i = 0; i < pixel_count; i++) {
         double diff = (double)img1->data[i] - (double)img2->data[i];
         sum += diff * diff;
     }
@@ -50,123 +54,771 @@ double calculate_psnr(PGMImage *original, PGMImage *modified) {
 }
 
 /**
- * Calculate the mean of a window in the image
+ * Window rows per SSIM band; fixed so that bands, and with them the order in
+ * which window scores are summed, do not depend on the thread count
  */
-static double calculate_window_mean(unsigned char *data, int width, int window_x, int window_y, int window_size) {
-    double sum = 0.0;
-    int count = 0;
-
-    for (int y = 0; y < window_size; y++) {
-        for (int x = 0; x < window_size; x++) {
-            int pos_x = window_x + x;
-            int pos_y = window_y + y;
-            sum += data[pos_y * width + pos_x];
-            count++;
+#define SSIM_BAND_ROWS 32
+
+/**
+ * Fixed-point scale of summed SSIM deficits
+ */
+#define SSIM_DEFICIT_SCALE 4294967296.0
+
+/**
+ * Pixels between flushes of the 32-bit squared-error lanes: each lane takes
+ * at most 2 * 255² per 8 pixels, so 16384 pixels stay far below 2^32
+ */
+#define ERROR_FLUSH_PIXELS 16384
+
+/**
+ * Per-column sums over the window rows of one band position: Σx, Σy, Σx²,
+ * Σy² and Σxy of the column's pixels. Every sum is exact in 32 bits
+ * (at most STEGO_SSIM_WINDOW * 255²).
+ */
+typedef struct {
+    uint32_t *x, *y, *xx, *yy, *xy;
+} SsimColumns;
+
+/**
+ * Pixel error totals of one worker; integer, so merging them in any order
+ * gives the same result
+ */
+typedef struct {
+    uint64_t squared_sum;
+    int max_abs;
+    uint64_t *histogram;        // Pixels per absolute difference (NULL skips it)
+} PixelErrors;
+
+/**
+ * One parallel quality pass over bands of window rows
+ */
+typedef struct {
+    const PGMImage *img1;
+    const PGMImage *img2;
+    int window_w;               // Window size, clipped to the image
+    int window_h;
+    int map_w;                  // Window positions per row and per column
+    int map_h;
+    int contrast_only;          // Score the contrast-structure term alone
+    SsimColumns *columns;       // One set per worker
+    PixelErrors *errors;        // One per worker, or NULL for SSIM alone
+    double *band_sums;          // Sum of the window scores of each band
+    double *map;                // Score of every window, or NULL
+} SsimJob;
+
+/**
+ * Add (or subtract) one row of both images to the column sums, and when
+ * `errors` is given count the row's pixel errors on the same load
+ */
+static void ssim_columns_add(const SsimColumns *cols, const unsigned char *a, const unsigned char *b,
+                             int width, int subtract, PixelErrors *errors) {
+    int x = 0;
+
+#ifdef __SSE2__
+    // Eight columns at a time: products of bytes fit unsigned 16-bit lanes
+    const __m128i zero = _mm_setzero_si128();
+    __m128i squared = zero;
+    __m128i max_abs = zero;
+    unsigned char abs_diffs[16];
+    for (; x + 8 <= width; x += 8) {
+        __m128i va = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(a + x)), zero);
+        __m128i vb = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(b + x)), zero);
+        __m128i terms[5] = { va, vb, _mm_mullo_epi16(va, va), _mm_mullo_epi16(vb, vb), _mm_mullo_epi16(va, vb) };
+        uint32_t *sums[5] = { cols->x, cols->y, cols->xx, cols->yy, cols->xy };
+
+        for (int k = 0; k < 5; k++) {
+            __m128i lo = _mm_unpacklo_epi16(terms[k], zero);
+            __m128i hi = _mm_unpackhi_epi16(terms[k], zero);
+            __m128i *dst = (__m128i *)(sums[k] + x);
+            __m128i s0 = _mm_loadu_si128(dst);
+            __m128i s1 = _mm_loadu_si128(dst + 1);
+            s0 = subtract ? _mm_sub_epi32(s0, lo) : _mm_add_epi32(s0, lo);
+            s1 = subtract ? _mm_sub_epi32(s1, hi) : _mm_add_epi32(s1, hi);
+            _mm_storeu_si128(dst, s0);
+            _mm_storeu_si128(dst + 1, s1);
+        }
+
+        if (errors) {
+            // madd squares the 16-bit differences and adds neighbouring pairs
+            __m128i diff = _mm_sub_epi16(va, vb);
+            __m128i abs = _mm_max_epi16(diff, _mm_sub_epi16(zero, diff));
+            squared = _mm_add_epi32(squared, _mm_madd_epi16(diff, diff));
+            max_abs = _mm_max_epi16(max_abs, abs);
+
+            if (errors->histogram) {
+                _mm_storeu_si128((__m128i *)abs_diffs, _mm_packus_epi16(abs, zero));
+                for (int k = 0; k < 8; k++) errors->histogram[abs_diffs[k]]++;
+            }
+
+            if ((x + 8) % ERROR_FLUSH_PIXELS == 0 || x + 16 > width) {
+                uint32_t lanes[4];
+                _mm_storeu_si128((__m128i *)lanes, squared);
+                errors->squared_sum += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+                squared = zero;
+            }
         }
     }
 
-    return sum / count;
+    if (errors) {
+        int16_t lanes[8];
+        _mm_storeu_si128((__m128i *)lanes, max_abs);
+        for (int k = 0; k < 8; k++) {
+            if (lanes[k] > errors->max_abs) errors->max_abs = lanes[k];
+        }
+    }
+#endif
+
+    // Unsigned wraparound makes subtracting a row the exact inverse of adding it
+    uint32_t sign = subtract ? (uint32_t)-1 : 1;
+    for (; x < width; x++) {
+        uint32_t va = a[x], vb = b[x];
+        cols->x[x] += sign * va;
+        cols->y[x] += sign * vb;
+        cols->xx[x] += sign * (va * va);
+        cols->yy[x] += sign * (vb * vb);
+        cols->xy[x] += sign * (va * vb);
+
+        if (errors) {
+            int abs = va > vb ? (int)(va - vb) : (int)(vb - va);
+            errors->squared_sum += (uint64_t)(abs * abs);
+            if (abs > errors->max_abs) errors->max_abs = abs;
+            if (errors->histogram) errors->histogram[abs]++;
+        }
+    }
+}
+
+/**
+ * SSIM of one window from its exact integer sums over n pixels
+ *
+ * Means, variances and the covariance are taken as in the usual
+ * population form, scaled by n² so that every difference is an exact
+ * integer: n²·var = n·Σx² − (Σx)².
+ */
+static double ssim_window(int64_t n, int64_t sx, int64_t sy, int64_t sxx, int64_t syy, int64_t sxy) {
+    // Constants for stability, scaled by n² like the sums
+    const double C1 = 6.5025;   // (0.01 * 255)^2
+    const double C2 = 58.5225;  // (0.03 * 255)^2
+    double n2 = (double)(n * n);
+
+    double var_x = (double)(n * sxx - sx * sx);
+    double var_y = (double)(n * syy - sy * sy);
+    double covar = (double)(n * sxy - sx * sy);
+
+    double numerator = (2.0 * (double)(sx * sy) + C1 * n2) * (2.0 * covar + C2 * n2);
+    double denominator = ((double)(sx * sx + sy * sy) + C1 * n2) * (var_x + var_y + C2 * n2);
+    return numerator / denominator;
 }
 
 /**
- * Calculate the variance of a window in the image
+ * Contrast-structure term of one window's SSIM (SSIM without the luminance
+ * factor), from the same sums as ssim_window
  */
-static double calculate_window_variance(unsigned char *data, int width, int window_x, int window_y, int window_size, double mean) {
+static double ssim_contrast_window(int64_t n, int64_t sx, int64_t sy, int64_t sxx, int64_t syy, int64_t sxy) {
+    const double C2 = 58.5225;  // (0.03 * 255)^2
+    double n2 = (double)(n * n);
+
+    double var_x = (double)(n * sxx - sx * sx);
+    double var_y = (double)(n * syy - sy * sy);
+    double covar = (double)(n * sxy - sx * sy);
+
+    return (2.0 * covar + C2 * n2) / (var_x + var_y + C2 * n2);
+}
+
+/**
+ * Score the windows whose top rows are [first, last) in a region of both
+ * images (rows `stride` bytes apart, `width` columns wide)
+ *
+ * Column sums slide down the region a row at a time (one row added, one
+ * removed) and window sums slide along each row a column at a time, so each
+ * pixel costs a constant number of integer operations whatever the window.
+ * Pixel errors are counted as rows come in.
+ * @param count_primed Count the errors of the rows above the first window's bottom row too
+ * @param contrast_only Score the contrast-structure term alone
+ * @param map Receives the scores of window row `first` onwards, map_stride apart (or NULL)
+ * @return Sum of the window scores
+ */
+static double ssim_rows(const SsimColumns *cols, const unsigned char *a, const unsigned char *b, size_t stride,
+                        int width, int window_w, int window_h, int first, int last,
+                        PixelErrors *errors, int count_primed, int contrast_only, double *map, size_t map_stride) {
+    int64_t n = (int64_t)window_w * window_h;
+    int map_w = width - window_w + 1;
+
+    memset(cols->x, 0, (size_t)width * sizeof(uint32_t));
+    memset(cols->y, 0, (size_t)width * sizeof(uint32_t));
+    memset(cols->xx, 0, (size_t)width * sizeof(uint32_t));
+    memset(cols->yy, 0, (size_t)width * sizeof(uint32_t));
+    memset(cols->xy, 0, (size_t)width * sizeof(uint32_t));
+    for (int y = first; y < first + window_h - 1; y++) {
+        ssim_columns_add(cols, a + (size_t)y * stride, b + (size_t)y * stride, width, 0,
+                         count_primed ? errors : NULL);
+    }
+
     double sum = 0.0;
-    int count = 0;
-
-    for (int y = 0; y < window_size; y++) {
-        for (int x = 0; x < window_size; x++) {
-            int pos_x = window_x + x;
-            int pos_y = window_y + y;
-            double diff = data[pos_y * width + pos_x] - mean;
-            sum += diff * diff;
-            count++;
+    for (int row = first; row < last; row++) {
+        // Bring the window's bottom row in; the top row leaves after the row is scored
+        int bottom = row + window_h - 1;
+        ssim_columns_add(cols, a + (size_t)bottom * stride, b + (size_t)bottom * stride, width, 0, errors);
+
+        int64_t sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+        for (int x = 0; x < window_w - 1; x++) {
+            sx += cols->x[x]; sy += cols->y[x];
+            sxx += cols->xx[x]; syy += cols->yy[x]; sxy += cols->xy[x];
         }
+
+        double *map_row = map ? map + (size_t)(row - first) * map_stride : NULL;
+        for (int x = 0; x < map_w; x++) {
+            int right = x + window_w - 1;
+            sx += cols->x[right]; sy += cols->y[right];
+            sxx += cols->xx[right]; syy += cols->yy[right]; sxy += cols->xy[right];
+
+            double ssim = contrast_only ? ssim_contrast_window(n, sx, sy, sxx, syy, sxy)
+                                        : ssim_window(n, sx, sy, sxx, syy, sxy);
+            sum += ssim;
+            if (map_row) map_row[x] = ssim;
+
+            sx -= cols->x[x]; sy -= cols->y[x];
+            sxx -= cols->xx[x]; syy -= cols->yy[x]; sxy -= cols->xy[x];
+        }
+
+        ssim_columns_add(cols, a + (size_t)row * stride, b + (size_t)row * stride, width, 1, NULL);
     }
 
-    return sum / count;
+    return sum;
 }
 
 /**
- * Calculate the covariance of two windows
+ * Range callback: score every window of bands [begin, end). Every image
+ * row enters exactly one band after the first band's opening rows, so each
+ * pixel's error is counted once.
  */
-static double calculate_window_covariance(unsigned char *data1, unsigned char *data2, int width1, int width2, 
-                                         int window_x1, int window_y1, int window_x2, int window_y2, 
-                                         int window_size, double mean1, double mean2) {
+static void ssim_band_range(void *arg, int64_t begin, int64_t end, int worker) {
+    SsimJob *job = (SsimJob *)arg;
+    PixelErrors *errors = job->errors ? &job->errors[worker] : NULL;
+    int width = job->img1->width;
+
+    for (int64_t band = begin; band < end; band++) {
+        int first = (int)band * SSIM_BAND_ROWS;
+        int last = first + SSIM_BAND_ROWS < job->map_h ? first + SSIM_BAND_ROWS : job->map_h;
+        double *map = job->map ? job->map + (size_t)first * job->map_w : NULL;
+
+        job->band_sums[band] = ssim_rows(&job->columns[worker], job->img1->data, job->img2->data, (size_t)width,
+                                         width, job->window_w, job->window_h, first, last,
+                                         errors, band == 0, job->contrast_only, map, (size_t)job->map_w);
+    }
+}
+
+/**
+ * One pass over both images: mean SSIM over every window position,
+ * optionally each window's score and, when `metrics` is given, the pixel
+ * error statistics too
+ * @param contrast_only Average the contrast-structure term instead of SSIM
+ * @param ssim Receives the SSIM
+ * @return 0 on success, -1 on failure
+ */
+static int quality_pass(ThreadPool *pool, PGMImage *img1, PGMImage *img2, int contrast_only, double *map,
+                        double *ssim, StegoQualityMetrics *metrics) {
+    if (!img1 || !img2 || !img1->data || !img2->data) {
+        fprintf(stderr, "Error: Invalid images for quality metrics\n");
+        return -1;
+    }
+
+    // Check if dimensions match
+    if (img1->width != img2->width || img1->height != img2->height) {
+        fprintf(stderr, "Error: Image dimensions do not match for quality metrics\n");
+        return -1;
+    }
+
+    SsimJob job;
+    job.img1 = img1;
+    job.img2 = img2;
+    job.window_w = img1->width < STEGO_SSIM_WINDOW ? img1->width : STEGO_SSIM_WINDOW;
+    job.window_h = img1->height < STEGO_SSIM_WINDOW ? img1->height : STEGO_SSIM_WINDOW;
+    job.map_w = img1->width - job.window_w + 1;
+    job.map_h = img1->height - job.window_h + 1;
+    job.contrast_only = contrast_only;
+    job.map = map;
+
+    int64_t bands = (job.map_h + SSIM_BAND_ROWS - 1) / SSIM_BAND_ROWS;
+    int workers = thread_pool_size(pool);
+    size_t width = (size_t)img1->width;
+
+    job.columns = (SsimColumns *)calloc((size_t)workers, sizeof(SsimColumns));
+    job.errors = metrics ? (PixelErrors *)calloc((size_t)workers, sizeof(PixelErrors)) : NULL;
+    job.band_sums = (double *)malloc((size_t)bands * sizeof(double));
+    uint64_t *histograms = metrics ? (uint64_t *)calloc((size_t)workers * 256, sizeof(uint64_t)) : NULL;
+    uint32_t *storage = (uint32_t *)malloc((size_t)workers * 5 * width * sizeof(uint32_t));
+    if (!job.columns || (metrics && (!job.errors || !histograms)) || !job.band_sums || !storage) {
+        fprintf(stderr, "Error: Failed to allocate SSIM buffers\n");
+        free(job.columns);
+        free(job.errors);
+        free(histograms);
+        free(job.band_sums);
+        free(storage);
+        return -1;
+    }
+
+    for (int w = 0; w < workers; w++) {
+        uint32_t *base = storage + (size_t)w * 5 * width;
+        SsimColumns cols = { base, base + width, base + 2 * width, base + 3 * width, base + 4 * width };
+        job.columns[w] = cols;
+        if (job.errors) job.errors[w].histogram = histograms + (size_t)w * 256;
+    }
+
+    thread_pool_parallel_for(pool, bands, 1, ssim_band_range, &job);
+
+    // Bands are added in order, so the result is the same for any pool
     double sum = 0.0;
-    int count = 0;
-
-    for (int y = 0; y < window_size; y++) {
-        for (int x = 0; x < window_size; x++) {
-            int pos_x1 = window_x1 + x;
-            int pos_y1 = window_y1 + y;
-            int pos_x2 = window_x2 + x;
-            int pos_y2 = window_y2 + y;
-            double diff1 = data1[pos_y1 * width1 + pos_x1] - mean1;
-            double diff2 = data2[pos_y2 * width2 + pos_x2] - mean2;
-            sum += diff1 * diff2;
-            count++;
+    for (int64_t band = 0; band < bands; band++) sum += job.band_sums[band];
+    *ssim = sum / ((double)job.map_w * job.map_h);
+
+    if (metrics) {
+        memset(metrics, 0, sizeof(StegoQualityMetrics));
+        uint64_t squared_sum = 0;
+        for (int w = 0; w < workers; w++) {
+            squared_sum += job.errors[w].squared_sum;
+            if (job.errors[w].max_abs > metrics->max_abs_error) metrics->max_abs_error = job.errors[w].max_abs;
+            for (int k = 0; k < 256; k++) metrics->histogram[k] += job.errors[w].histogram[k];
         }
+
+        // As calculate_mse and calculate_psnr
+        double max_value = img1->max_gray;
+        metrics->mse = (double)squared_sum / ((double)img1->width * img1->height);
+        metrics->psnr = metrics->mse > 0.0 ? 10.0 * log10((max_value * max_value) / metrics->mse) : 100.0;
+        metrics->ssim = *ssim;
     }
 
-    return sum / count;
+    free(job.columns);
+    free(job.errors);
+    free(histograms);
+    free(job.band_sums);
+    free(storage);
+    return 0;
 }
 
 /**
  * Calculate the Structural Similarity Index (SSIM) between two images
- * Using a simplified version with small windows
+ * over every 8x8 window
  */
 double calculate_ssim(PGMImage *img1, PGMImage *img2) {
+    double ssim;
+    return quality_pass(NULL, img1, img2, 0, NULL, &ssim, NULL) == 0 ? ssim : -1.0;
+}
+
+/**
+ * Calculate SSIM on the context's worker pool
+ */
+double stego_context_ssim(StegoContext *ctx, PGMImage *img1, PGMImage *img2) {
+    double ssim;
+    return quality_pass(stego_context_pool(ctx), img1, img2, 0, NULL, &ssim, NULL) == 0 ? ssim : -1.0;
+}
+
+/**
+ * Calculate SSIM on the context's worker pool, keeping every window's score
+ */
+double stego_context_ssim_map(StegoContext *ctx, PGMImage *img1, PGMImage *img2, double *map) {
+    double ssim;
+    return quality_pass(stego_context_pool(ctx), img1, img2, 0, map, &ssim, NULL) == 0 ? ssim : -1.0;
+}
+
+/**
+ * Calculate every quality metric in one pass over both images
+ */
+int compute_quality_metrics(PGMImage *img1, PGMImage *img2, StegoQualityMetrics *metrics) {
+    double ssim;
+    return quality_pass(NULL, img1, img2, 0, NULL, &ssim, metrics);
+}
+
+/**
+ * Calculate every quality metric in one pass on the context's worker pool
+ */
+int stego_context_quality_metrics(StegoContext *ctx, PGMImage *img1, PGMImage *img2,
+                                  StegoQualityMetrics *metrics) {
+    double ssim;
+    return quality_pass(stego_context_pool(ctx), img1, img2, 0, NULL, &ssim, metrics);
+}
+
+/**
+ * Scales of MS-SSIM and their exponents (Wang, Simoncelli and Bovik, 2003)
+ */
+#define MS_SSIM_LEVELS 5
+static const double ms_ssim_weights[MS_SSIM_LEVELS] = { 0.0448, 0.2856, 0.3001, 0.2363, 0.1333 };
+
+/**
+ * Output rows per chunk of a pyramid level
+ */
+#define PYRAMID_CHUNK_ROWS 64
+
+/**
+ * One parallel 2x2 reduction of both images to the next pyramid level
+ */
+typedef struct {
+    const unsigned char *src[2];
+    unsigned char *dst[2];
+    size_t src_stride;          // Width of the finer level
+    int width;                  // Width of the coarser level
+} PyramidJob;
+
+/**
+ * Average each 2x2 square of two rows into one row of `width` pixels,
+ * rounding to nearest
+ */
+static void box_halve_row(const unsigned char *row0, const unsigned char *row1, unsigned char *dst, int width) {
+    int x = 0;
+
+#ifdef __SSE2__
+    // Sixteen source columns to eight: even and odd bytes split into 16-bit lanes
+    const __m128i low_bytes = _mm_set1_epi16(0x00FF);
+    const __m128i two = _mm_set1_epi16(2);
+    for (; x + 8 <= width; x += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(row0 + 2 * x));
+        __m128i b = _mm_loadu_si128((const __m128i *)(row1 + 2 * x));
+        __m128i sum = _mm_add_epi16(_mm_and_si128(a, low_bytes), _mm_srli_epi16(a, 8));
+        sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_and_si128(b, low_bytes), _mm_srli_epi16(b, 8)));
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+        _mm_storel_epi64((__m128i *)(dst + x), _mm_packus_epi16(sum, sum));
+    }
+#endif
+
+    for (; x < width; x++) {
+        dst[x] = (unsigned char)((row0[2 * x] + row0[2 * x + 1] + row1[2 * x] + row1[2 * x + 1] + 2) >> 2);
+    }
+}
+
+/**
+ * Range callback: reduce rows [begin, end) of the coarser level of both images
+ */
+static void pyramid_range(void *arg, int64_t begin, int64_t end, int worker) {
+    PyramidJob *job = (PyramidJob *)arg;
+    (void)worker;
+
+    for (int i = 0; i < 2; i++) {
+        for (int64_t y = begin; y < end; y++) {
+            const unsigned char *row0 = job->src[i] + (size_t)(2 * y) * job->src_stride;
+            box_halve_row(row0, row0 + job->src_stride, job->dst[i] + (size_t)y * job->width, job->width);
+        }
+    }
+}
+
+/**
+ * MS-SSIM of two images: the contrast-structure term at each finer scale
+ * and the full SSIM at the coarsest, combined as a weighted geometric mean.
+ * Each scale halves the previous one with a 2x2 box filter (odd edges are
+ * dropped) and is scored by the exact window pass, so the result does not
+ * depend on the pool. Scales stop before either side falls below the
+ * window; the weights of the scales used are normalised to sum to one.
+ * @param ms_ssim Receives the MS-SSIM
+ * @return 0 on success, -1 on failure
+ */
+static int ms_ssim_pass(ThreadPool *pool, PGMImage *img1, PGMImage *img2, double *ms_ssim) {
     if (!img1 || !img2 || !img1->data || !img2->data) {
-        fprintf(stderr, "Error: Invalid images for SSIM calculation\n");
-        return -1.0;
+        fprintf(stderr, "Error: Invalid images for MS-SSIM\n");
+        return -1;
     }
 
-    // Check if dimensions match
     if (img1->width != img2->width || img1->height != img2->height) {
-        fprintf(stderr, "Error: Image dimensions do not match for SSIM calculation\n");
-        return -1.0;
+        fprintf(stderr, "Error: Image dimensions do not match for MS-SSIM\n");
+        return -1;
+    }
+
+    int levels = 1;
+    size_t pyramid_pixels = 0;
+    while (levels < MS_SSIM_LEVELS && (img1->width >> levels) >= STEGO_SSIM_WINDOW &&
+           (img1->height >> levels) >= STEGO_SSIM_WINDOW) {
+        pyramid_pixels += (size_t)(img1->width >> levels) * (img1->height >> levels);
+        levels++;
+    }
+
+    // Both pyramids are built once, level by level, in one buffer
+    unsigned char *pyramid = pyramid_pixels > 0 ? (unsigned char *)malloc(2 * pyramid_pixels) : NULL;
+    if (pyramid_pixels > 0 && !pyramid) {
+        fprintf(stderr, "Error: Failed to allocate the MS-SSIM pyramid\n");
+        return -1;
+    }
+
+    double weight_total = 0.0;
+    for (int level = 0; level < levels; level++) weight_total += ms_ssim_weights[level];
+
+    PGMImage level1 = *img1;
+    PGMImage level2 = *img2;
+    unsigned char *next = pyramid;
+    double product = 1.0;
+    int status = 0;
+    for (int level = 0; level < levels && status == 0; level++) {
+        int coarsest = level == levels - 1;
+        double score;
+        status = quality_pass(pool, &level1, &level2, !coarsest, NULL, &score, NULL);
+
+        // Negative terms (anti-correlated structure) count as no similarity
+        if (status == 0) product *= pow(score > 0.0 ? score : 0.0, ms_ssim_weights[level] / weight_total);
+        if (status != 0 || coarsest) break;
+
+        PyramidJob job;
+        job.src[0] = level1.data;
+        job.src[1] = level2.data;
+        job.src_stride = (size_t)level1.width;
+        job.width = level1.width / 2;
+        int height = level1.height / 2;
+        job.dst[0] = next;
+        job.dst[1] = next + pyramid_pixels;
+        thread_pool_parallel_for(pool, height, PYRAMID_CHUNK_ROWS, pyramid_range, &job);
+
+        level1.width = level2.width = job.width;
+        level1.height = level2.height = height;
+        level1.data = job.dst[0];
+        level2.data = job.dst[1];
+        next += (size_t)job.width * height;
+    }
+
+    free(pyramid);
+    if (status == 0) *ms_ssim = product;
+    return status;
+}
+
+/**
+ * Calculate the multi-scale SSIM between two images
+ */
+double calculate_ms_ssim(PGMImage *img1, PGMImage *img2) {
+    double ms_ssim;
+    return ms_ssim_pass(NULL, img1, img2, &ms_ssim) == 0 ? ms_ssim : -1.0;
+}
+
+/**
+ * Calculate the multi-scale SSIM on the context's worker pool
+ */
+double stego_context_ms_ssim(StegoContext *ctx, PGMImage *img1, PGMImage *img2) {
+    double ms_ssim;
+    return ms_ssim_pass(stego_context_pool(ctx), img1, img2, &ms_ssim) == 0 ? ms_ssim : -1.0;
+}
+
+/**
+ * Blocks per chunk of a block quality pass
+ */
+#define BLOCK_QUALITY_CHUNK 64
+
+/**
+ * One parallel pass over the blocks of the embedding grid
+ */
+typedef struct {
+    const PGMImage *img1;
+    const PGMImage *img2;
+    int block_size;
+    int blocks_x;
+    int window;                 // Window side, clipped to the block
+    SsimColumns *columns;       // One set of block_size columns per worker
+    StegoBlockQuality *blocks;
+} BlockQualityJob;
+
+/**
+ * Range callback: measure blocks [begin, end)
+ */
+static void block_quality_range(void *arg, int64_t begin, int64_t end, int worker) {
+    BlockQualityJob *job = (BlockQualityJob *)arg;
+    int block_size = job->block_size;
+    int positions = block_size - job->window + 1;
+    size_t stride = (size_t)job->img1->width;
+    double max_value = job->img1->max_gray;
+
+    for (int64_t block = begin; block < end; block++) {
+        // Same layout as the embed's blocks
+        size_t offset = (size_t)(block / job->blocks_x) * block_size * stride
+                      + (size_t)(block % job->blocks_x) * block_size;
+        PixelErrors errors = { 0, 0, NULL };
+
+        double sum = ssim_rows(&job->columns[worker], job->img1->data + offset, job->img2->data + offset, stride,
+                               block_size, job->window, job->window, 0, positions, &errors, 1, 0, NULL, 0);
+
+        StegoBlockQuality *quality = &job->blocks[block];
+        quality->mse = (double)errors.squared_sum / ((double)block_size * block_size);
+        quality->psnr = quality->mse > 0.0 ? 10.0 * log10((max_value * max_value) / quality->mse) : 100.0;
+        quality->ssim = sum / ((double)positions * positions);
+        quality->max_abs_error = errors.max_abs;
+    }
+}
+
+/**
+ * Calculate the quality of every block of the embedding grid
+ */
+StegoBlockQuality* stego_context_block_quality(StegoContext *ctx, PGMImage *img1, PGMImage *img2,
+                                               int *block_size, int *blocks_x, int *blocks_y) {
+    if (!ctx || !img1 || !img2 || !img1->data || !img2->data) {
+        fprintf(stderr, "Error: Invalid images for block quality\n");
+        return NULL;
+    }
+
+    if (img1->width != img2->width || img1->height != img2->height) {
+        fprintf(stderr, "Error: Image dimensions do not match for block quality\n");
+        return NULL;
     }
 
-    // Constants for stability
-    const double C1 = 6.5025; // (0.01 * 255)^2
-    const double C2 = 58.5225; // (0.03 * 255)^2
-    
-    // Window size for SSIM calculation (typically 8x8 or 11x11)
-    const int window_size = 8;
-    
-    // Number of windows to sample (for performance)
-    const int max_windows = 100;
-    
-    double ssim_sum = 0.0;
-    int window_count = 0;
-    
-    // Calculate SSIM for random windows
-    srand(time(NULL));
-    
-    for (int i = 0; i < max_windows; i++) {
-        // Random window position
-        int window_x = rand() % (img1->width - window_size);
-        int window_y = rand() % (img1->height - window_size);
-        
-        // Calculate statistics for the windows
-        double mean1 = calculate_window_mean(img1->data, img1->width, window_x, window_y, window_size);
-        double mean2 = calculate_window_mean(img2->data, img2->width, window_x, window_y, window_size);
-        double var1 = calculate_window_variance(img1->data, img1->width, window_x, window_y, window_size, mean1);
-        double var2 = calculate_window_variance(img2->data, img2->width, window_x, window_y, window_size, mean2);
-        double covar = calculate_window_covariance(img1->data, img2->data, img1->width, img2->width, 
-                                                window_x, window_y, window_x, window_y, 
-                                                window_size, mean1, mean2);
-        
-        // Calculate SSIM for this window
-        double numerator = (2 * mean1 * mean2 + C1) * (2 * covar + C2);
-        double denominator = (mean1 * mean1 + mean2 * mean2 + C1) * (var1 + var2 + C2);
-        double ssim = numerator / denominator;
-        
-        ssim_sum += ssim;
-        window_count++;
-    }
-    
-    return ssim_sum / window_count;
-} 
\ No newline at end of file
+    BlockQualityJob job;
+    job.img1 = img1;
+    job.img2 = img2;
+    job.block_size = resolve_block_size(ctx->config.block_size);
+    job.blocks_x = img1->width / job.block_size;
+    job.window = job.block_size < STEGO_SSIM_WINDOW ? job.block_size : STEGO_SSIM_WINDOW;
+
+    int rows = img1->height / job.block_size;
+    int64_t count = (int64_t)job.blocks_x * rows;
+    if (count == 0) {
+        fprintf(stderr, "Error: Image is smaller than one %dx%d block\n", job.block_size, job.block_size);
+        return NULL;
+    }
+
+    ThreadPool *pool = stego_context_pool(ctx);
+    int workers = thread_pool_size(pool);
+    size_t width = (size_t)job.block_size;
+
+    job.columns = (SsimColumns *)calloc((size_t)workers, sizeof(SsimColumns));
+    job.blocks = (StegoBlockQuality *)malloc((size_t)count * sizeof(StegoBlockQuality));
+    uint32_t *storage = (uint32_t *)malloc((size_t)workers * 5 * width * sizeof(uint32_t));
+    if (!job.columns || !job.blocks || !storage) {
+        fprintf(stderr, "Error: Failed to allocate block quality buffers\n");
+        free(job.columns);
+        free(job.blocks);
+        free(storage);
+        return NULL;
+    }
+
+    for (int w = 0; w < workers; w++) {
+        uint32_t *base = storage + (size_t)w * 5 * width;
+        SsimColumns cols = { base, base + width, base + 2 * width, base + 3 * width, base + 4 * width };
+        job.columns[w] = cols;
+    }
+
+    thread_pool_parallel_for(pool, count, BLOCK_QUALITY_CHUNK, block_quality_range, &job);
+
+    free(job.columns);
+    free(storage);
+    if (block_size) *block_size = job.block_size;
+    if (blocks_x) *blocks_x = job.blocks_x;
+    if (blocks_y) *blocks_y = rows;
+    return job.blocks;
+}
+
+/**
+ * Draw block qualities as a heatmap of their MSE
+ */
+PGMImage* stego_block_quality_heatmap(const StegoBlockQuality *blocks, int blocks_x, int blocks_y,
+                                      int block_size, int width, int height) {
+    if (!blocks || blocks_x * block_size > width || blocks_y * block_size > height) return NULL;
+
+    PGMImage *heatmap = (PGMImage *)calloc(1, sizeof(PGMImage));
+    if (!heatmap) return NULL;
+
+    heatmap->width = width;
+    heatmap->height = height;
+    heatmap->max_gray = 255;
+    heatmap->data = pgm_alloc_pixels((size_t)width * height);
+    if (!heatmap->data) {
+        free(heatmap);
+        return NULL;
+    }
+    memset(heatmap->data, 0, (size_t)width * height);
+
+    int64_t count = (int64_t)blocks_x * blocks_y;
+    double worst = 0.0;
+    for (int64_t k = 0; k < count; k++) {
+        if (blocks[k].mse > worst) worst = blocks[k].mse;
+    }
+
+    for (int64_t k = 0; k < count; k++) {
+        unsigned char level = (unsigned char)(worst > 0.0 ? blocks[k].mse / worst * 255.0 + 0.5 : 0.0);
+        unsigned char *origin = heatmap->data + (size_t)(k / blocks_x) * block_size * width
+                                              + (size_t)(k % blocks_x) * block_size;
+        for (int i = 0; i < block_size; i++) memset(origin + (size_t)i * width, level, block_size);
+    }
+
+    return heatmap;
+}
+
+/**
+ * Write block qualities as CSV
+ */
+int stego_block_quality_write_csv(const StegoBlockQuality *blocks, int blocks_x, int blocks_y,
+                                  int block_size, FILE *file) {
+    fprintf(file, "block,x,y,mse,psnr,ssim,max_abs_error\n");
+
+    int64_t count = (int64_t)blocks_x * blocks_y;
+    for (int64_t k = 0; k < count; k++) {
+        fprintf(file, "%lld,%d,%d,%.6f,%.4f,%.6f,%d\n", (long long)k,
+                (int)(k % blocks_x) * block_size, (int)(k / blocks_x) * block_size,
+                blocks[k].mse, blocks[k].psnr, blocks[k].ssim, blocks[k].max_abs_error);
+    }
+
+    return ferror(file) ? -1 : 0;
+}
+
+/**
+ * Keep the cover pixels of a block about to be rewritten
+ */
+void embed_quality_save(EmbedQuality *quality, const unsigned char *block, size_t stride, int block_size, int slot) {
+    unsigned char *saved = quality->saved + (size_t)slot * block_size * block_size;
+
+    for (int i = 0; i < block_size; i++) {
+        memcpy(saved + (size_t)i * block_size, block + (size_t)i * stride, block_size);
+    }
+}
+
+/**
+ * Compare a rewritten block with its saved cover pixels, tile by tile
+ */
+void embed_quality_compare(EmbedQuality *quality, const unsigned char *block, size_t stride, int block_size, int slot) {
+    const unsigned char *saved = quality->saved + (size_t)slot * block_size * block_size;
+    const int tile = STEGO_SSIM_WINDOW;
+    uint64_t block_error = 0;
+
+    // Block sizes are multiples of the tile, so tiles never straddle blocks
+    for (int ty = 0; ty < block_size; ty += tile) {
+        for (int tx = 0; tx < block_size; tx += tile) {
+            int64_t sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+            uint64_t tile_error = 0;
+
+            for (int i = ty; i < ty + tile; i++) {
+                const unsigned char *a = saved + (size_t)i * block_size;
+                const unsigned char *b = block + (size_t)i * stride;
+                for (int j = tx; j < tx + tile; j++) {
+                    int x = a[j], y = b[j];
+                    int abs = x > y ? x - y : y - x;
+                    sx += x; sy += y;
+                    sxx += x * x; syy += y * y; sxy += x * y;
+                    tile_error += (uint64_t)(abs * abs);
+                    if (abs > quality->max_abs_error) quality->max_abs_error = abs;
+                }
+            }
+
+            // An unchanged tile scores exactly 1
+            if (tile_error > 0) {
+                double deficit = 1.0 - ssim_window((int64_t)tile * tile, sx, sy, sxx, syy, sxy);
+                quality->ssim_deficit += (uint64_t)llround(deficit * SSIM_DEFICIT_SCALE);
+                block_error += tile_error;
+            }
+        }
+    }
+
+    if (block_error > 0) {
+        quality->squared_error += block_error;
+        quality->blocks_changed++;
+    }
+}
+
+/**
+ * Merge the workers' quality totals into a report
+ */
+void embed_quality_report(const EmbedQuality *quality, int workers, int width, int height, StegoEmbedReport *report) {
+    uint64_t ssim_deficit = 0;
+
+    memset(report, 0, sizeof(StegoEmbedReport));
+    for (int w = 0; w < workers; w++) {
+        report->blocks_changed += quality[w].blocks_changed;
+        report->squared_error += quality[w].squared_error;
+        ssim_deficit += quality[w].ssim_deficit;
+        if (quality[w].max_abs_error > report->max_abs_error) report->max_abs_error = quality[w].max_abs_error;
+    }
+
+    // As compute_quality_metrics, for a peak of 255
+    report->mse = (double)report->squared_error / ((double)width * height);
+    report->psnr = report->mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / report->mse) : 100.0;
+
+    double tiles = (double)(width / STEGO_SSIM_WINDOW) * (height / STEGO_SSIM_WINDOW);
+    report->ssim = tiles > 0.0 ? 1.0 - (double)ssim_deficit / SSIM_DEFICIT_SCALE / tiles : 1.0;
+}
@@ -0,0 +1,122 @@
+/**
+ * spsc_queue.c
+ * Bounded single-producer single-consumer ring buffer
+ *
+ * The producer only writes `tail` and the consumer only writes `head`, so
+ * each side publishes its progress with one release store and no lock. A
+ * side that finds the ring full (or empty) yields, then backs off to short
+ * sleeps, so a stage waiting on slow I/O does not hold a core.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../include/spsc_queue.h"
+
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#include <time.h>
+#endif
+
+/**
+ * Waits that only yield before the waiting side starts sleeping
+ */
+#define SPSC_QUEUE_YIELDS 64
+
+struct SpscQueue {
+    unsigned long head;         // Next slot to pop (written by the consumer)
+    char pad0[64 - sizeof(unsigned long)];
+    unsigned long tail;         // Next slot to push (written by the producer)
+    char pad1[64 - sizeof(unsigned long)];
+    unsigned long capacity;
+    void **slots;
+};
+
+/**
+ * Wait a little before checking the ring again
+ */
+static void queue_backoff(int *waits) {
+    if (*waits < SPSC_QUEUE_YIELDS) {
+        ++*waits;
+#ifdef _WIN32
+        Sleep(0);
+#else
+        sched_yield();
+#endif
+        return;
+    }
+
+#ifdef _WIN32
+    Sleep(1);
+#else
+    struct timespec pause = { 0, 50000 };
+    nanosleep(&pause, NULL);
+#endif
+}
+
+/**
+ * Create a queue
+ */
+SpscQueue* spsc_queue_create(int capacity) {
+    if (capacity < 1) capacity = 1;
+
+    SpscQueue *queue = (SpscQueue *)calloc(1, sizeof(SpscQueue));
+    if (!queue) return NULL;
+
+    queue->slots = (void **)calloc(capacity, sizeof(void *));
+    if (!queue->slots) {
+        free(queue);
+        return NULL;
+    }
+
+    queue->capacity = (unsigned long)capacity;
+    return queue;
+}
+
+/**
+ * Free a queue
+ */
+void spsc_queue_destroy(SpscQueue *queue) {
+    if (!queue) return;
+
+    free(queue->slots);
+    free(queue);
+}
+
+/**
+ * Append an item, waiting while the queue is full
+ */
+void spsc_queue_push(SpscQueue *queue, void *item) {
+    unsigned long tail = queue->tail;
+    int waits = 0;
+
+    // The acquire pairs with the consumer's release of head, so the slot
+    // is no longer being read once it shows as free
+    while (tail - __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) >= queue->capacity) {
+        queue_backoff(&waits);
+    }
+
+    queue->slots[tail % queue->capacity] = item;
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Remove the oldest item, waiting while the queue is empty
+ */
+void* spsc_queue_pop(SpscQueue *queue) {
+    unsigned long head = queue->head;
+    int waits = 0;
+
+    // The acquire pairs with the producer's release of tail, so the item
+    // (and everything written before it was pushed) is visible
+    while (__atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) == head) {
+        queue_backoff(&waits);
+    }
+
+    void *item = queue->slots[head % queue->capacity];
+    __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+    return item;
+}
@@ -3,41 +3,967 @@
  * Implementation of steganography functions using G-let D3 wavelet transform
  */
 
-#include "../include/steganography.h"
+#include "stego_internal.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * Round a double value to the nearest integer and clip to [0, 255]
+ */
+static int clip_to_byte(double val) {
+    int rounded = (int)(val + 0.5);
+    if (rounded < 0) return 0;
+    if (rounded > 255) return 255;
+    return rounded;
+}
+
+/**
+ * Check if a number is a power of 2
+ */
+static int is_power_of_two(int n) {
+    return (n != 0) && ((n & (n - 1)) == 0);
+}
+
+/**
+ * Get the next power of 2 greater than or equal to n
+ */
+static int next_power_of_two(int n) {
+    if (n <= 0) return 1;
+    if (is_power_of_two(n)) return n;
+    
+    n--;
+    n |= n >> 1;
+    n |= n >> 2;
+    n |= n >> 4;
+    n |= n >> 8;
+    n |= n >> 16;
+    n++;
+    
+    return n;
+}
+
+/**
+ * Round a requested block size up to a power of 2
+ */
+int resolve_block_size(int requested) {
+    return is_power_of_two(requested) ? requested : next_power_of_two(requested);
+}
+
+/**
+ * Point a codec at the image (or band) whose blocks it reads and writes
+ */
+static void block_codec_bind(BlockCodec *codec, const PGMImageView *view) {
+    codec->view = view;
+    codec->blocks_x = view ? view->width / codec->block_size : 0;
+}
+
+/**
+ * Set up a codec for an image, allocating its tile and workspace once
+ * @param view Image to bind (or NULL to bind later)
+ * @return 0 on success, -1 on failure
+ */
+static int block_codec_init(BlockCodec *codec, const PGMImageView *view, int block_size, const StegoConfig *config) {
+    int coefs = block_size * block_size;
+
+    codec->block_size = block_size;
+    block_codec_bind(codec, view);
+    codec->transform = config->transform;
+    codec->embedding_factor = config->embedding_strength / 10.0;
+    codec->lifting_step = config->embedding_strength > 0 ? config->embedding_strength : 1;
+    codec->tile = codec->workspace = NULL;
+    codec->int_tile = codec->int_workspace = NULL;
+
+    if (codec->transform == STEGO_TRANSFORM_LIFTING) {
+        codec->lanes = GLET_D3_INT_LANES;
+        codec->scratch = malloc(codec->lanes * (coefs + GLET_D3_WORKSPACE_SIZE(block_size)) * sizeof(int32_t));
+        if (!codec->scratch) return -1;
+        codec->int_tile = (int32_t *)codec->scratch;
+        codec->int_workspace = codec->int_tile + codec->lanes * coefs;
+    } else {
+        // Pick the transform kernel for this block size once for the whole image
+        codec->kernel = glet_d3_select_kernel(block_size);
+        codec->lanes = codec->kernel.lanes;
+        codec->scratch = malloc(codec->lanes * (coefs + GLET_D3_WORKSPACE_SIZE(block_size)) * sizeof(double));
+        if (!codec->scratch) return -1;
+        codec->tile = (double *)codec->scratch;
+        codec->workspace = codec->tile + codec->lanes * coefs;
+    }
+
+    return 0;
+}
+
+/**
+ * Release the codec's tile and workspace
+ */
+static void block_codec_free(BlockCodec *codec) {
+    free(codec->scratch);
+    codec->scratch = NULL;
+}
+
+/**
+ * Copy image block `block_idx` into lane `lane` of the tile, or zero the lane
+ * when block_idx is negative (unused lanes of a partial group); pixels
+ * outside the image read as 0
+ */
+static void block_codec_load(BlockCodec *codec, int lane, int64_t block_idx) {
+    const PGMImageView *view = codec->view;
+    int block_size = codec->block_size;
+    int lanes = codec->lanes;
+    int bx = block_idx > 0 ? (int)(block_idx % codec->blocks_x) : 0;
+    int by = block_idx > 0 ? (int)(block_idx / codec->blocks_x) : 0;
+
+    for (int i = 0; i < block_size; i++) {
+        for (int j = 0; j < block_size; j++) {
+            int y = by * block_size + i;
+            int x = bx * block_size + j;
+            int k = (i * block_size + j) * lanes + lane;
+            int value = 0;
+
+            if (block_idx >= 0 && y < view->height && x < view->width) {
+                value = view->data[y * view->stride + x];
+            }
+
+            if (codec->transform == STEGO_TRANSFORM_LIFTING) {
+                codec->int_tile[k] = value;
+            } else {
+                codec->tile[k] = value;
+            }
+        }
+    }
+}
+
+/**
+ * Write lane `lane` of the tile back into image block `block_idx`
+ */
+static void block_codec_store(BlockCodec *codec, int lane, int64_t block_idx) {
+    const PGMImageView *view = codec->view;
+    int block_size = codec->block_size;
+    int lanes = codec->lanes;
+    int bx = block_idx > 0 ? (int)(block_idx % codec->blocks_x) : 0;
+    int by = block_idx > 0 ? (int)(block_idx / codec->blocks_x) : 0;
+
+    for (int i = 0; i < block_size; i++) {
+        for (int j = 0; j < block_size; j++) {
+            int y = by * block_size + i;
+            int x = bx * block_size + j;
+            int k = (i * block_size + j) * lanes + lane;
+
+            if (y >= view->height || x >= view->width) continue;
+
+            if (codec->transform == STEGO_TRANSFORM_LIFTING) {
+                int32_t value = codec->int_tile[k];
+                view->data[y * view->stride + x] = value < 0 ? 0 : (value > 255 ? 255 : (unsigned char)value);
+            } else {
+                view->data[y * view->stride + x] = clip_to_byte(codec->tile[k]);
+            }
+        }
+    }
+}
+
+/**
+ * Apply the forward transform to every lane of the tile
+ */
+static void block_codec_forward(BlockCodec *codec) {
+    if (codec->transform == STEGO_TRANSFORM_LIFTING) {
+        glet_d3_forward_int(codec->int_tile, codec->block_size, codec->lanes, codec->int_workspace);
+    } else {
+        codec->kernel.forward(codec->tile, codec->block_size, codec->workspace);
+    }
+}
+
+/**
+ * Apply the inverse transform to every lane of the tile
+ */
+static void block_codec_inverse(BlockCodec *codec) {
+    if (codec->transform == STEGO_TRANSFORM_LIFTING) {
+        glet_d3_inverse_int(codec->int_tile, codec->block_size, codec->lanes, codec->int_workspace);
+    } else {
+        codec->kernel.inverse(codec->tile, codec->block_size, codec->workspace);
+    }
+}
+
+/**
+ * Read coefficient (row, col) of lane `lane`
+ */
+static double block_codec_get(const BlockCodec *codec, int lane, int row, int col) {
+    int k = (row * codec->block_size + col) * codec->lanes + lane;
+    return codec->transform == STEGO_TRANSFORM_LIFTING ? codec->int_tile[k] : codec->tile[k];
+}
+
+/**
+ * Move coefficient (row, col) of lane `lane` towards the sign of a payload bit
+ * @return Nonzero if the coefficient changed
+ */
+static int block_codec_mark(BlockCodec *codec, int lane, int row, int col, int bit) {
+    int k = (row * codec->block_size + col) * codec->lanes + lane;
+
+    if (codec->transform == STEGO_TRANSFORM_LIFTING) {
+        // The integer round trip is exact, so forcing the sign with a margin
+        // survives until extraction unless the block clips
+        int32_t *coef = &codec->int_tile[k];
+        int32_t target = bit ? codec->lifting_step : -codec->lifting_step;
+        if (bit ? *coef < target : *coef > target) {
+            *coef = target;
+            return 1;
+        }
+        return 0;
+    }
+
+    // For 1, make coefficient slightly more positive; for 0, more negative
+    if (bit) {
+        codec->tile[k] += codec->embedding_factor;
+    } else {
+        codec->tile[k] -= codec->embedding_factor;
+    }
+    return 1;
+}
+
+/**
+ * Copy a block's cached lifting coefficients into lane `lane` of the tile,
+ * or zero the lane when coefficients is NULL
+ */
+static void block_codec_load_coefficients(BlockCodec *codec, int lane, const int32_t *coefficients) {
+    int coefs = codec->block_size * codec->block_size;
+
+    for (int k = 0; k < coefs; k++) {
+        codec->int_tile[k * codec->lanes + lane] = coefficients ? coefficients[k] : 0;
+    }
+}
+
+/**
+ * Precompute the delta pattern of every byte value for a block size and strength
+ * @return 0 on success, -1 on failure
+ */
+static int build_delta_patterns(DeltaPatterns *patterns, int block_size, double embedding_factor) {
+    int coefs = block_size * block_size;
+    int half = block_size / 2;
+    GletKernel kernel = glet_d3_select_kernel(block_size);
+
+    // Spatial image of each payload coefficient moved by +embedding_factor
+    double *basis = (double *)calloc(8 * coefs + GLET_D3_WORKSPACE_SIZE(block_size), sizeof(double));
+    if (!basis) return -1;
+    double *workspace = basis + 8 * coefs;
+
+    patterns->rows = 0;
+    patterns->cols = 0;
+    for (int bit = 0; bit < 8; bit++) {
+        double *block = basis + bit * coefs;
+        block[(half + bit % 4) * block_size + half + bit / 4] = embedding_factor;
+        kernel.inverse(block, block_size, workspace);
+
+        // Grow the region to cover every pixel the coefficient reaches
+        for (int k = 0; k < coefs; k++) {
+            if (fabs(block[k]) > 1e-9) {
+                if (k / block_size + 1 > patterns->rows) patterns->rows = k / block_size + 1;
+                if (k % block_size + 1 > patterns->cols) patterns->cols = k % block_size + 1;
+            }
+        }
+    }
+
+    patterns->deltas = (int16_t *)malloc(256 * patterns->rows * patterns->cols * sizeof(int16_t));
+    if (!patterns->deltas) {
+        free(basis);
+        return -1;
+    }
+
+    for (int value = 0; value < 256; value++) {
+        int16_t *pattern = patterns->deltas + value * patterns->rows * patterns->cols;
+
+        for (int i = 0; i < patterns->rows; i++) {
+            for (int j = 0; j < patterns->cols; j++) {
+                double delta = 0;
+                for (int bit = 0; bit < 8; bit++) {
+                    double d = basis[bit * coefs + i * block_size + j];
+                    delta += ((value >> bit) & 1) ? d : -d;
+                }
+
+                // clip_to_byte(p + delta) == clip(p + floor(delta + 0.5)) for integer p
+                *pattern++ = (int16_t)floor(delta + 0.5);
+            }
+        }
+    }
+
+    free(basis);
+    return 0;
+}
+
+/**
+ * Top-left pixel of image block `block_idx`
+ */
+static unsigned char* block_origin(const PGMImageView *view, int64_t block_idx, int blocks_x, int block_size) {
+    return view->data + (size_t)(block_idx / blocks_x) * block_size * view->stride
+                      + (size_t)(block_idx % blocks_x) * block_size;
+}
+
+/**
+ * Add the delta pattern of a secret byte to an image block, saturating to [0, 255]
+ */
+static void apply_delta_pattern(const PGMImageView *view, int64_t block_idx, int blocks_x, int block_size,
+                                const DeltaPatterns *patterns, unsigned char value) {
+    const int16_t *pattern = patterns->deltas + value * patterns->rows * patterns->cols;
+    unsigned char *row = view->data + (size_t)(block_idx / blocks_x) * block_size * view->stride
+                                    + (size_t)(block_idx % blocks_x) * block_size;
+
+    for (int i = 0; i < patterns->rows; i++) {
+        for (int j = 0; j < patterns->cols; j++) {
+            int pixel = row[j] + pattern[i * patterns->cols + j];
+            row[j] = pixel < 0 ? 0 : (pixel > 255 ? 255 : (unsigned char)pixel);
+        }
+        row += view->stride;
+    }
+}
+
+/**
+ * Trade the delta pattern of one secret byte in an image block for that of
+ * another, saturating to [0, 255]. Unless the first pattern clipped, the
+ * block ends up exactly as if the new byte had been embedded into the cover.
+ */
+static void swap_delta_pattern(const PGMImageView *view, int64_t block_idx, int blocks_x, int block_size,
+                               const DeltaPatterns *patterns, unsigned char old_value, unsigned char new_value) {
+    const int16_t *old_pattern = patterns->deltas + old_value * patterns->rows * patterns->cols;
+    const int16_t *new_pattern = patterns->deltas + new_value * patterns->rows * patterns->cols;
+    unsigned char *row = view->data + (size_t)(block_idx / blocks_x) * block_size * view->stride
+                                    + (size_t)(block_idx % blocks_x) * block_size;
+
+    for (int i = 0; i < patterns->rows; i++) {
+        for (int j = 0; j < patterns->cols; j++) {
+            int k = i * patterns->cols + j;
+            int pixel = row[j] - old_pattern[k] + new_pattern[k];
+            row[j] = pixel < 0 ? 0 : (pixel > 255 ? 255 : (unsigned char)pixel);
+        }
+        row += view->stride;
+    }
+}
+
+/**
+ * Read the secret byte carried by a payload block straight from its pixels.
+ * Bit b sits in the finest-level HH coefficient over pixel rows 2(b%4)..+1
+ * and columns 2(b/4)..+1. Under both the Haar and the lifting transform that
+ * coefficient has the sign of the integer x00 - x01 - x10 + x11, so the 8
+ * signs need one 4-tap projection each instead of a full block transform.
+ */
+static unsigned char extract_block_byte(const PGMImageView *view, int64_t block_idx, int blocks_x, int block_size) {
+    size_t stride = view->stride;
+    const unsigned char *block = view->data + (size_t)(block_idx / blocks_x) * block_size * stride
+                                            + (size_t)(block_idx % blocks_x) * block_size;
+
+#ifdef __SSE2__
+    // Columns 0-3 of rows 0-7: even rows in one register, odd rows in another
+    int32_t rows[8];
+    for (int i = 0; i < 8; i++) {
+        memcpy(&rows[i], block + i * stride, sizeof(int32_t));
+    }
+    const __m128i zero = _mm_setzero_si128();
+    __m128i even = _mm_set_epi32(rows[6], rows[4], rows[2], rows[0]);
+    __m128i odd = _mm_set_epi32(rows[7], rows[5], rows[3], rows[1]);
+
+    // Vertical differences, then horizontal ones: madd pairs (d0, d1) into d0 - d1
+    const __m128i taps = _mm_set1_epi32(0xFFFF0001);
+    __m128i lo = _mm_madd_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(even, zero), _mm_unpacklo_epi8(odd, zero)), taps);
+    __m128i hi = _mm_madd_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(even, zero), _mm_unpackhi_epi8(odd, zero)), taps);
+
+    // lo holds bits (0, 4, 1, 5) and hi bits (2, 6, 3, 7); put them in bit order
+    lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 1, 2, 0));
+    hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 1, 2, 0));
+    __m128i coefs = _mm_packs_epi32(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+
+    // A bit is 1 when its coefficient is non-negative
+    return (unsigned char)~_mm_movemask_epi8(_mm_packs_epi16(coefs, zero));
+#else
+    unsigned char pixel = 0;
+
+    for (int bit = 0; bit < 8; bit++) {
+        const unsigned char *p = block + 2 * (bit % 4) * stride + 2 * (bit / 4);
+        int coef = p[0] - p[1] - p[stride] + p[stride + 1];
+        pixel |= (unsigned char)((coef >= 0) << bit);
+    }
+
+    return pixel;
+#endif
+}
+
+/**
+ * Write the secret dimensions and configuration into the metadata block
+ */
+int write_metadata_block(const PGMImageView *view, int block_size, const StegoConfig *config,
+                         int secret_width, int secret_height) {
+    StegoHeader header;
+    header.version = STEGO_HEADER_VERSION;
+    header.secret_width = secret_width;
+    header.secret_height = secret_height;
+    header.block_size = block_size;
+    header.embedding_strength = config->embedding_strength;
+    header.use_random_blocks = config->use_random_blocks;
+    header.transform = config->transform;
+
+    return stego_header_write(view, &header);
+}
+
+/**
+ * Read the secret dimensions and configuration from the metadata block
+ */
+int read_metadata_block(const PGMImageView *view, int block_size, StegoConfig *config,
+                        int *secret_width, int *secret_height) {
+    StegoHeader header;
+    if (stego_header_read(view, &header) == 0) {
+        *secret_width = header.secret_width;
+        *secret_height = header.secret_height;
+        config->block_size = header.block_size;
+        config->embedding_strength = header.embedding_strength;
+        config->use_random_blocks = header.use_random_blocks;
+        config->transform = header.transform;
+        return 0;
+    }
+
+    // Images embedded before the stego header keep these five fields as raw
+    // values in the high-frequency coefficients of a block_size block
+    BlockCodec codec;
+    if (block_codec_init(&codec, view, block_size, config) != 0) return -1;
+
+    block_codec_load(&codec, 0, 0);
+    for (int lane = 1; lane < codec.lanes; lane++) {
+        block_codec_load(&codec, lane, -1);
+    }
+
+    // Apply forward G-let D3 transform
+    block_codec_forward(&codec);
+
+    // Extract secret image dimensions and configuration from high-frequency coefficients
+    int half = block_size / 2;
+    *secret_width = (int)block_codec_get(&codec, 0, half, half + 1);
+    *secret_height = (int)block_codec_get(&codec, 0, half + 1, half);
+    config->block_size = (int)block_codec_get(&codec, 0, half + 2, half);
+    config->embedding_strength = (int)block_codec_get(&codec, 0, half + 3, half);
+    config->use_random_blocks = (int)block_codec_get(&codec, 0, half + 3, half + 1);
+
+    block_codec_free(&codec);
+    return 0;
+}
+
+/**
+ * Payload items handed to a worker at a time
+ */
+#define PAYLOAD_CHUNK_BLOCKS 2048
+
+/**
+ * One parallel pass of an engine over payload items. An item is a payload
+ * pixel in whole-image passes, which then visit only the blocks in use, or
+ * a payload block position in band passes, which visit the band's blocks in
+ * memory order.
+ */
+typedef struct {
+    PayloadEngine *engine;
+    const BlockBand *band;
+    int by_block;               // Items are block positions rather than pixels
+    int64_t first_item;         // Item of range index 0
+    const unsigned char *secret_in; // Embedding source
+    unsigned char *secret_out;  // Extraction target
+    int64_t secret_offset;      // Pixel i is written to secret_out[i - secret_offset]
+} PayloadJob;
+
+/**
+ * One parallel pass filling a transformed-cover cache
+ */
+typedef struct {
+    const PGMImageView *cover;
+    BlockCodec *codecs;         // One per worker
+    StegoCoverCache *cache;
+} CacheJob;
+
+/**
+ * One parallel pass extracting a rectangle of the secret
+ */
+typedef struct {
+    PayloadEngine *engine;
+    const PGMImageView *view;
+    int secret_width;
+    const StegoRegion *region;
+    unsigned char *out;         // region->width * region->height pixels
+} RegionJob;
+
+/**
+ * One parallel pass rewriting payload blocks gathered into a column view
+ */
+typedef struct {
+    PayloadEngine *engine;
+    const PGMImageView *column; // Block k holds the image block of updates[k]
+    const PayloadUpdate *updates;
+} UpdateJob;
+
+/**
+ * Resolve a payload item into its pixel and the band-relative block carrying it
+ * @return 0 if the item carries no payload pixel
+ */
+static int payload_item(const PayloadJob *job, int64_t item, int64_t *pixel, int64_t *block) {
+    const PayloadEngine *engine = job->engine;
+    int random = engine->config->use_random_blocks;
+    int64_t position;
+
+    if (job->by_block) {
+        position = item;
+        *pixel = random ? (int64_t)stego_permutation_invert(&engine->permutation, position) : position;
+        if (*pixel >= engine->payload_pixels) return 0;
+    } else {
+        *pixel = item;
+        position = random ? (int64_t)stego_permutation_apply(&engine->permutation, item) : item;
+    }
+
+    // +1 skips the metadata block
+    *block = position + 1 - job->band->first_block;
+    return 1;
+}
+
+/**
+ * Embed payload items [begin, end) by adding their delta patterns
+ */
+static void embed_patterns_range(void *arg, int64_t begin, int64_t end, int worker) {
+    PayloadJob *job = (PayloadJob *)arg;
+    PayloadEngine *engine = job->engine;
+    EmbedQuality *quality = engine->quality ? &engine->quality[worker] : NULL;
+    const PGMImageView *view = job->band->view;
+    int block_size = engine->block_size;
+
+    for (int64_t i = begin; i < end; i++) {
+        int64_t pixel, block;
+        if (!payload_item(job, job->first_item + i, &pixel, &block)) continue;
+
+        unsigned char *origin = quality ? block_origin(view, block, engine->blocks_x, block_size) : NULL;
+        if (quality) embed_quality_save(quality, origin, view->stride, block_size, 0);
+
+        apply_delta_pattern(view, block, engine->blocks_x, block_size, engine->patterns, job->secret_in[pixel]);
+
+        if (quality) embed_quality_compare(quality, origin, view->stride, block_size, 0);
+    }
+}
+
+/**
+ * Embed payload items [begin, end) through the worker's transform codec,
+ * `lanes` blocks at a time
+ */
+static void embed_codec_range(void *arg, int64_t begin, int64_t end, int worker) {
+    PayloadJob *job = (PayloadJob *)arg;
+    BlockCodec *codec = &job->engine->codecs[worker];
+    const StegoCoverCache *cache = job->engine->cache;
+    EmbedQuality *quality = job->engine->quality ? &job->engine->quality[worker] : NULL;
+    int lanes = codec->lanes;
+    int half = job->engine->block_size / 2;
+    int64_t blocks[BLOCK_CODEC_MAX_LANES];
+    unsigned char pixels[BLOCK_CODEC_MAX_LANES];
+
+    block_codec_bind(codec, job->band->view);
+
+    int64_t i = begin;
+    while (i < end) {
+        // Gather the next `lanes` blocks that carry a payload pixel
+        int group = 0;
+        for (; i < end && group < lanes; i++) {
+            int64_t pixel, block;
+            if (!payload_item(job, job->first_item + i, &pixel, &block)) continue;
+
+            blocks[group] = block;
+            pixels[group] = job->secret_in[pixel];
+            group++;
+        }
+        if (group == 0) break;
+
+        // Blocks of a transformed-cover cache skip the forward transform
+        int cached = cache != NULL;
+        for (int lane = 0; lane < group && cached; lane++) {
+            cached = blocks[lane] + job->band->first_block < cache->cached_blocks;
+        }
+
+        if (cached) {
+            for (int lane = 0; lane < lanes; lane++) {
+                block_codec_load_coefficients(codec, lane, lane < group ?
+                    stego_cover_cache_block(cache, blocks[lane] + job->band->first_block) : NULL);
+            }
+        } else {
+            for (int lane = 0; lane < lanes; lane++) {
+                block_codec_load(codec, lane, lane < group ? blocks[lane] : -1);
+            }
+
+            // Apply forward G-let D3 transform to every block of the group
+            block_codec_forward(codec);
+        }
+
+        int changed = 0;
+        for (int lane = 0; lane < group; lane++) {
+            // Embed 8 bits of the pixel into 8 different high-frequency coefficients
+            for (int bit = 0; bit < 8; bit++) {
+                // Select a high-frequency coefficient position (avoid low frequencies)
+                changed |= block_codec_mark(codec, lane, half + bit % 4, half + bit / 4, (pixels[lane] >> bit) & 1);
+            }
+        }
+
+        // The inverse of unchanged coefficients gives back the cover pixels
+        if (!changed) continue;
+
+        // Apply inverse G-let D3 transform
+        block_codec_inverse(codec);
+
+        // Copy modified blocks back to stego image, comparing them with the
+        // cover pixels they replace while both are in cache
+        const PGMImageView *view = job->band->view;
+        for (int lane = 0; lane < group; lane++) {
+            unsigned char *origin = quality ? block_origin(view, blocks[lane], codec->blocks_x, codec->block_size) : NULL;
+            if (quality) embed_quality_save(quality, origin, view->stride, codec->block_size, lane);
+
+            block_codec_store(codec, lane, blocks[lane]);
+
+            if (quality) embed_quality_compare(quality, origin, view->stride, codec->block_size, lane);
+        }
+    }
+}
+
+/**
+ * Extract payload items [begin, end) by projection
+ */
+static void extract_range(void *arg, int64_t begin, int64_t end, int worker) {
+    PayloadJob *job = (PayloadJob *)arg;
+    PayloadEngine *engine = job->engine;
+    (void)worker;
+
+    for (int64_t i = begin; i < end; i++) {
+        int64_t pixel, block;
+        if (!payload_item(job, job->first_item + i, &pixel, &block)) continue;
+
+        job->secret_out[pixel - job->secret_offset] =
+            extract_block_byte(job->band->view, block, engine->blocks_x, engine->block_size);
+    }
+}
+
+/**
+ * Build the context's Haar delta patterns for a block size, reusing the
+ * previous ones when the block size and strength are unchanged
+ */
+static int context_delta_patterns(StegoContext *ctx, int block_size) {
+    int strength = ctx->config.embedding_strength;
+    if (ctx->patterns.deltas && ctx->patterns_block_size == block_size && ctx->patterns_strength == strength) {
+        return 0;
+    }
+
+    free(ctx->patterns.deltas);
+    ctx->patterns.deltas = NULL;
+    if (build_delta_patterns(&ctx->patterns, block_size, strength / 10.0) != 0) return -1;
+
+    ctx->patterns_block_size = block_size;
+    ctx->patterns_strength = strength;
+    return 0;
+}
+
+/**
+ * Release the context's lifting tiles
+ */
+static void context_free_codecs(StegoContext *ctx) {
+    for (int i = 0; i < ctx->num_codecs; i++) {
+        block_codec_free(&ctx->codecs[i]);
+    }
+    free(ctx->codecs);
+    ctx->codecs = NULL;
+    ctx->num_codecs = 0;
+}
+
+/**
+ * Build one lifting tile per worker for a block size, reusing the previous
+ * tiles when there are enough of them and nothing else changed
+ */
+static int context_codecs(StegoContext *ctx, int block_size, int workers) {
+    int strength = ctx->config.embedding_strength;
+    if (ctx->num_codecs >= workers && ctx->codecs_block_size == block_size && ctx->codecs_strength == strength) {
+        return 0;
+    }
+
+    context_free_codecs(ctx);
+    ctx->codecs = (BlockCodec *)malloc(workers * sizeof(BlockCodec));
+    if (!ctx->codecs) return -1;
+
+    ctx->codecs_block_size = block_size;
+    ctx->codecs_strength = strength;
+    for (; ctx->num_codecs < workers; ctx->num_codecs++) {
+        if (block_codec_init(&ctx->codecs[ctx->num_codecs], NULL, block_size, &ctx->config) != 0) {
+            context_free_codecs(ctx);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Release the patterns and tiles a context keeps between calls
+ */
+void stego_context_release_scratch(StegoContext *ctx) {
+    free(ctx->patterns.deltas);
+    ctx->patterns.deltas = NULL;
+    context_free_codecs(ctx);
+}
+
+/**
+ * Set up an engine for an image of the given size
+ */
+int payload_engine_init(PayloadEngine *engine, StegoContext *ctx, int block_size,
+                        int image_width, int image_height, int64_t secret_pixels, int embedding) {
+    const StegoConfig *config = &ctx->config;
+
+    memset(engine, 0, sizeof(PayloadEngine));
+    engine->config = config;
+    engine->block_size = block_size;
+    engine->blocks_x = image_width / block_size;
+
+    // Every whole block but the first one, which holds the metadata
+    engine->total_blocks = (int64_t)engine->blocks_x * (image_height / block_size) - 1;
+    if (engine->total_blocks < 0) engine->total_blocks = 0;
+    engine->payload_pixels = secret_pixels < engine->total_blocks ? secret_pixels : engine->total_blocks;
+
+    // Random block order: a keyed permutation evaluated per block, no table
+    stego_permutation_init(&engine->permutation, engine->total_blocks, config->random_seed);
+
+    engine->pool = stego_context_pool(ctx);
+
+    if (!embedding) return 0;
+
+    if (config->transform == STEGO_TRANSFORM_HAAR) {
+        // The payload change of a block depends only on the secret byte, so
+        // add precomputed spatial patterns instead of transforming each block
+        if (context_delta_patterns(ctx, block_size) != 0) return -1;
+        engine->patterns = &ctx->patterns;
+    } else {
+        // Lifting marks depend on each block's own coefficients, so every
+        // worker transforms its blocks in its own tile
+        if (context_codecs(ctx, block_size, thread_pool_size(engine->pool)) != 0) return -1;
+        engine->codecs = ctx->codecs;
+    }
+
+    return 0;
+}
+
+/**
+ * Allocate per-worker quality totals for the engine's embeds
+ */
+int payload_engine_track_quality(PayloadEngine *engine) {
+    int workers = thread_pool_size(engine->pool);
+    size_t saved_bytes = (size_t)BLOCK_CODEC_MAX_LANES * engine->block_size * engine->block_size;
+
+    engine->quality = (EmbedQuality *)calloc((size_t)workers, sizeof(EmbedQuality));
+    if (!engine->quality) return -1;
+
+    for (int w = 0; w < workers; w++) {
+        engine->quality[w].saved = pgm_alloc_pixels(saved_bytes);
+        if (!engine->quality[w].saved) return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Release the engine (its pool and scratch stay with the context)
+ */
+void payload_engine_free(PayloadEngine *engine) {
+    if (engine->quality) {
+        for (int w = 0; w < thread_pool_size(engine->pool); w++) free(engine->quality[w].saved);
+        free(engine->quality);
+    }
+
+    memset(engine, 0, sizeof(PayloadEngine));
+}
+
+/**
+ * Range callback embedding with the engine's transform
+ */
+static ThreadPoolRangeFn embed_range_fn(const PayloadEngine *engine) {
+    return engine->config->transform == STEGO_TRANSFORM_HAAR ? embed_patterns_range : embed_codec_range;
+}
+
+/**
+ * Payload block positions held by a band, clipped to those that can carry pixels
+ * @return Number of positions, starting at *first
+ */
+static int64_t band_positions(const PayloadEngine *engine, const BlockBand *band, int64_t *first) {
+    // Position p is block p + 1 (block 0 holds the metadata)
+    int64_t begin = band->first_block > 0 ? band->first_block - 1 : 0;
+    int64_t end = band->end_block - 1;
+
+    if (end > engine->total_blocks) end = engine->total_blocks;
+
+    // In sequential order the payload ends at position payload_pixels
+    if (!engine->config->use_random_blocks && end > engine->payload_pixels) {
+        end = engine->payload_pixels;
+    }
+
+    *first = begin;
+    return end > begin ? end - begin : 0;
+}
+
+/**
+ * Embed every payload pixel into an image held entirely in memory
+ */
+void payload_engine_embed_image(PayloadEngine *engine, const PGMImageView *view, const unsigned char *secret) {
+    BlockBand band = { view, 0, engine->total_blocks + 1 };
+    PayloadJob job = { engine, &band, 0, 0, secret, NULL, 0 };
+
+    thread_pool_parallel_for(engine->pool, engine->payload_pixels, PAYLOAD_CHUNK_BLOCKS, embed_range_fn(engine), &job);
+}
+
+/**
+ * Extract every payload pixel from an image held entirely in memory
+ */
+void payload_engine_extract_image(PayloadEngine *engine, const PGMImageView *view, unsigned char *secret) {
+    BlockBand band = { view, 0, engine->total_blocks + 1 };
+    PayloadJob job = { engine, &band, 0, 0, NULL, secret, 0 };
+
+    thread_pool_parallel_for(engine->pool, engine->payload_pixels, PAYLOAD_CHUNK_BLOCKS, extract_range, &job);
+}
+
+/**
+ * Embed the payload pixels carried by the blocks of a band
+ */
+void payload_engine_embed_band(PayloadEngine *engine, const BlockBand *band, const unsigned char *secret) {
+    int64_t first;
+    int64_t count = band_positions(engine, band, &first);
+    PayloadJob job = { engine, band, 1, first, secret, NULL, 0 };
+
+    thread_pool_parallel_for(engine->pool, count, PAYLOAD_CHUNK_BLOCKS, embed_range_fn(engine), &job);
+}
+
+/**
+ * Extract the payload pixels carried by the blocks of a band
+ */
+void payload_engine_extract_band(PayloadEngine *engine, const BlockBand *band,
+                                 unsigned char *secret, int64_t secret_offset) {
+    int64_t first;
+    int64_t count = band_positions(engine, band, &first);
+    PayloadJob job = { engine, band, 1, first, NULL, secret, secret_offset };
+
+    thread_pool_parallel_for(engine->pool, count, PAYLOAD_CHUNK_BLOCKS, extract_range, &job);
+}
+
+/**
+ * Range callback: extract region pixels [begin, end), row-major in the region
+ */
+static void extract_region_range(void *arg, int64_t begin, int64_t end, int worker) {
+    RegionJob *job = (RegionJob *)arg;
+    PayloadEngine *engine = job->engine;
+    const StegoRegion *region = job->region;
+    int random = engine->config->use_random_blocks;
+    (void)worker;
+
+    for (int64_t i = begin; i < end; i++) {
+        int64_t pixel = (int64_t)(region->y + i / region->width) * job->secret_width + region->x + i % region->width;
+
+        // Pixels beyond the cover's capacity were never embedded
+        if (pixel >= engine->payload_pixels) {
+            job->out[i] = 0;
+            continue;
+        }
+
+        int64_t position = random ? (int64_t)stego_permutation_apply(&engine->permutation, pixel) : pixel;
+        // +1 skips the metadata block
+        job->out[i] = extract_block_byte(job->view, position + 1, engine->blocks_x, engine->block_size);
+    }
+}
 
 /**
- * Round a double value to the nearest integer and clip to [0, 255]
+ * Extract only the payload pixels of a rectangle of the secret
  */
-static int clip_to_byte(double val) {
-    int rounded = (int)(val + 0.5);
-    if (rounded < 0) return 0;
-    if (rounded > 255) return 255;
-    return rounded;
+void payload_engine_extract_region(PayloadEngine *engine, const PGMImageView *view, int secret_width,
+                                   const StegoRegion *region, unsigned char *out) {
+    RegionJob job = { engine, view, secret_width, region, out };
+
+    thread_pool_parallel_for(engine->pool, (int64_t)region->width * region->height,
+                             PAYLOAD_CHUNK_BLOCKS, extract_region_range, &job);
 }
 
 /**
- * Check if a number is a power of 2
+ * Order payload updates by image block
  */
-static int is_power_of_two(int n) {
-    return (n != 0) && ((n & (n - 1)) == 0);
+static int compare_updates(const void *a, const void *b) {
+    int64_t block_a = ((const PayloadUpdate *)a)->block;
+    int64_t block_b = ((const PayloadUpdate *)b)->block;
+    return (block_a > block_b) - (block_a < block_b);
 }
 
 /**
- * Get the next power of 2 greater than or equal to n
+ * List the payload blocks whose secret byte differs between two secrets
  */
-static int next_power_of_two(int n) {
-    if (n <= 0) return 1;
-    if (is_power_of_two(n)) return n;
-    
-    n--;
-    n |= n >> 1;
-    n |= n >> 2;
-    n |= n >> 4;
-    n |= n >> 8;
-    n |= n >> 16;
-    n++;
-    
-    return n;
+int64_t payload_engine_diff(const PayloadEngine *engine, const unsigned char *old_secret,
+                            const unsigned char *new_secret, PayloadUpdate *updates) {
+    int random = engine->config->use_random_blocks;
+    int64_t count = 0;
+
+    for (int64_t pixel = 0; pixel < engine->payload_pixels; pixel++) {
+        if (old_secret[pixel] == new_secret[pixel]) continue;
+
+        if (updates) {
+            int64_t position = random ? (int64_t)stego_permutation_apply(&engine->permutation, pixel) : pixel;
+            // +1 skips the metadata block
+            updates[count].block = position + 1;
+            updates[count].old_value = old_secret[pixel];
+            updates[count].new_value = new_secret[pixel];
+        }
+        count++;
+    }
+
+    // Sequential order already yields ascending blocks
+    if (updates && random) qsort(updates, (size_t)count, sizeof(PayloadUpdate), compare_updates);
+    return count;
+}
+
+/**
+ * Range callback: move gathered blocks [begin, end) from their old secret
+ * byte to their new one
+ */
+static void update_range(void *arg, int64_t begin, int64_t end, int worker) {
+    UpdateJob *job = (UpdateJob *)arg;
+    PayloadEngine *engine = job->engine;
+
+    if (engine->config->transform == STEGO_TRANSFORM_HAAR) {
+        for (int64_t k = begin; k < end; k++) {
+            swap_delta_pattern(job->column, k, 1, engine->block_size, engine->patterns,
+                               job->updates[k].old_value, job->updates[k].new_value);
+        }
+        return;
+    }
+
+    // Lifting forces coefficient signs, so re-marking the stego block with
+    // the new byte leaves the bits that keep their value untouched
+    BlockCodec *codec = &engine->codecs[worker];
+    int lanes = codec->lanes;
+    int half = engine->block_size / 2;
+
+    block_codec_bind(codec, job->column);
+
+    for (int64_t k = begin; k < end; k += lanes) {
+        int group = end - k < lanes ? (int)(end - k) : lanes;
+
+        for (int lane = 0; lane < lanes; lane++) {
+            block_codec_load(codec, lane, lane < group ? k + lane : -1);
+        }
+        block_codec_forward(codec);
+
+        for (int lane = 0; lane < group; lane++) {
+            for (int bit = 0; bit < 8; bit++) {
+                block_codec_mark(codec, lane, half + bit % 4, half + bit / 4,
+                                 (job->updates[k + lane].new_value >> bit) & 1);
+            }
+        }
+
+        block_codec_inverse(codec);
+        for (int lane = 0; lane < group; lane++) {
+            block_codec_store(codec, lane, k + lane);
+        }
+    }
+}
+
+/**
+ * Rewrite the payload blocks gathered into a column view
+ */
+void payload_engine_update_blocks(PayloadEngine *engine, const PGMImageView *column,
+                                  const PayloadUpdate *updates, int64_t count) {
+    UpdateJob job = { engine, column, updates };
+
+    thread_pool_parallel_for(engine->pool, count, PAYLOAD_CHUNK_BLOCKS, update_range, &job);
 }
 
 /**
@@ -49,6 +975,8 @@ StegoConfig create_default_config() {
     config.embedding_strength = 5;      // Medium embedding strength
     config.use_random_blocks = 0;       // No randomization by default
     config.random_seed = time(NULL);    // Current time as seed
+    config.transform = STEGO_TRANSFORM_HAAR; // Floating-point Haar
+    config.num_threads = 1;             // Single-threaded by default
     return config;
 }
 
@@ -69,421 +997,432 @@ PGMImage* extract_image(PGMImage *stego, int width, int height) {
 }
 
 /**
- * Embed a secret PGM image into a cover PGM image using G-let D3 steganography
+ * Write the metadata block and the payload into an image holding the cover,
+ * taking cover coefficients from a cache when one is given
  */
-PGMImage* embed_image_with_config(PGMImage *cover, PGMImage *secret, StegoConfig *config) {
-    if (!cover || !secret || !cover->data || !secret->data) {
-        fprintf(stderr, "Error: Invalid input images\n");
-        return NULL;
+static int embed_payload_cached(StegoContext *ctx, const PGMImageView *stego, PGMImage *secret,
+                                const StegoCoverCache *cache) {
+    // Determine block size (next power of 2)
+    int block_size = resolve_block_size(ctx->config.block_size);
+
+    if (block_size < MIN_EMBED_BLOCK_SIZE) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Block size must be at least %d", MIN_EMBED_BLOCK_SIZE);
+        return -1;
+    }
+
+    PayloadEngine engine;
+    if (payload_engine_init(&engine, ctx, block_size, stego->width, stego->height,
+                            (int64_t)secret->width * secret->height, 1) != 0 ||
+        (ctx->report && payload_engine_track_quality(&engine) != 0)) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Failed to allocate embedding buffers");
+        payload_engine_free(&engine);
+        return -1;
+    }
+
+    // Write secret image dimensions and config in the first block, then the
+    // secret pixels in the remaining blocks
+    int track_metadata = engine.quality && engine.blocks_x > 0 && stego->height >= block_size;
+    if (track_metadata) embed_quality_save(engine.quality, stego->data, stego->stride, block_size, 0);
+    if (write_metadata_block(stego, block_size, &ctx->config, secret->width, secret->height) != 0) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Secret dimensions or configuration do not fit the stego header");
+        payload_engine_free(&engine);
+        return -1;
+    }
+    if (track_metadata) embed_quality_compare(engine.quality, stego->data, stego->stride, block_size, 0);
+
+    engine.cache = cache;
+    payload_engine_embed_image(&engine, stego, secret->data);
+
+    if (engine.quality) {
+        embed_quality_report(engine.quality, thread_pool_size(engine.pool), stego->width, stego->height, ctx->report);
     }
+    payload_engine_free(&engine);
+    return 0;
+}
+
+/**
+ * Write the metadata block and the payload into an image holding the cover
+ */
+int embed_payload(StegoContext *ctx, const PGMImageView *stego, PGMImage *secret) {
+    return embed_payload_cached(ctx, stego, secret, NULL);
+}
 
-    // Use default config if none provided
-    StegoConfig default_config;
-    if (!config) {
-        default_config = create_default_config();
-        config = &default_config;
+/**
+ * Embed a secret image in place into pixels owned by the caller
+ */
+int stego_context_embed(StegoContext *ctx, const PGMImageView *cover, PGMImage *secret) {
+    if (!cover || !secret || !cover->data || !secret->data || cover->stride < (size_t)cover->width) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Invalid input images");
+        return -1;
     }
 
     // Verify that the secret image can fit in the cover image
     if (cover->width < secret->width || cover->height < secret->height) {
-        fprintf(stderr, "Error: Secret image is larger than cover image\n");
-        return NULL;
+        stego_log(ctx, STEGO_LOG_ERROR, "Secret image is larger than cover image");
+        return -1;
     }
 
-    // Create a copy of the cover image
-    PGMImage *stego = (PGMImage *)malloc(sizeof(PGMImage));
-    if (!stego) return NULL;
+    return embed_payload(ctx, cover, secret);
+}
 
-    stego->width = cover->width;
-    stego->height = cover->height;
-    stego->max_gray = cover->max_gray;
-    stego->data = (unsigned char *)malloc(stego->width * stego->height * sizeof(unsigned char));
-    
-    if (!stego->data) {
-        free(stego);
-        return NULL;
-    }
+/**
+ * Range callback: forward-transform cover blocks [begin, end) into a cache
+ */
+static void cache_range(void *arg, int64_t begin, int64_t end, int worker) {
+    CacheJob *job = (CacheJob *)arg;
+    BlockCodec *codec = &job->codecs[worker];
+    int lanes = codec->lanes;
+    int coefs = codec->block_size * codec->block_size;
 
-    // Copy cover image data
-    memcpy(stego->data, cover->data, stego->width * stego->height * sizeof(unsigned char));
+    block_codec_bind(codec, job->cover);
 
-    // Determine block size (next power of 2)
-    int block_size = is_power_of_two(config->block_size) ? 
-                     config->block_size : next_power_of_two(config->block_size);
+    for (int64_t block = begin; block < end; block += lanes) {
+        int group = end - block < lanes ? (int)(end - block) : lanes;
 
-    // Calculate the number of blocks in the cover image
-    int blocks_x = stego->width / block_size;
-    int blocks_y = stego->height / block_size;
+        for (int lane = 0; lane < lanes; lane++) {
+            block_codec_load(codec, lane, lane < group ? block + lane : -1);
+        }
+        block_codec_forward(codec);
 
-    // Set random seed if using random blocks
-    if (config->use_random_blocks) {
-        srand(config->random_seed);
+        for (int lane = 0; lane < group; lane++) {
+            int32_t *coefficients = job->cache->coefficients + (block + lane) * coefs;
+            for (int k = 0; k < coefs; k++) {
+                coefficients[k] = codec->int_tile[k * lanes + lane];
+            }
+        }
     }
+}
 
-    // Write secret image dimensions and config in the first block (for extraction later)
-    // We'll use the high-frequency coefficients of the first block
-    double *first_block = (double *)malloc(block_size * block_size * sizeof(double));
-    if (!first_block) {
-        free(stego->data);
-        free(stego);
+/**
+ * Forward-transform the blocks of a cover for repeated embedding
+ */
+StegoCoverCache* stego_cover_cache_create(StegoContext *ctx, const PGMImageView *cover, size_t max_bytes) {
+    if (!cover || !cover->data || cover->stride < (size_t)cover->width) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Invalid cover image");
         return NULL;
     }
 
-    // Copy first block data to double array
-    for (int i = 0; i < block_size; i++) {
-        for (int j = 0; j < block_size; j++) {
-            if (i < stego->height && j < stego->width) {
-                first_block[i * block_size + j] = stego->data[i * stego->width + j];
-            } else {
-                first_block[i * block_size + j] = 0;
-            }
-        }
+    int block_size = resolve_block_size(ctx->config.block_size);
+    if (block_size < MIN_EMBED_BLOCK_SIZE) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Block size must be at least %d", MIN_EMBED_BLOCK_SIZE);
+        return NULL;
     }
 
-    // Apply forward G-let D3 transform
-    glet_d3_forward(first_block, block_size);
-
-    // Embed secret image dimensions and config in high-frequency coefficients
-    // We'll use positions that won't visibly affect the image
-    first_block[block_size * (block_size / 2) + block_size / 2 + 1] = secret->width;
-    first_block[block_size * (block_size / 2 + 1) + block_size / 2] = secret->height;
-    first_block[block_size * (block_size / 2 + 2) + block_size / 2] = config->block_size;
-    first_block[block_size * (block_size / 2 + 3) + block_size / 2] = config->embedding_strength;
-    first_block[block_size * (block_size / 2 + 4) + block_size / 2] = config->use_random_blocks;
-
-    // Apply inverse G-let D3 transform
-    glet_d3_inverse(first_block, block_size);
-
-    // Copy modified first block back to stego image
-    for (int i = 0; i < block_size && i < stego->height; i++) {
-        for (int j = 0; j < block_size && j < stego->width; j++) {
-            stego->data[i * stego->width + j] = clip_to_byte(first_block[i * block_size + j]);
-        }
-    }
+    StegoCoverCache *cache = (StegoCoverCache *)calloc(1, sizeof(StegoCoverCache));
+    if (!cache) return NULL;
 
-    free(first_block);
+    cache->width = cover->width;
+    cache->height = cover->height;
+    cache->block_size = block_size;
+    cache->hash = stego_cover_hash(cover);
 
-    // Process each block (skip the first block which contains metadata)
-    double *cover_block = (double *)malloc(block_size * block_size * sizeof(double));
-    if (!cover_block) {
-        free(stego->data);
-        free(stego);
-        return NULL;
+    // Haar embedding never transforms cover blocks: its delta patterns
+    // depend only on the secret, so there is nothing to cache
+    if (ctx->config.transform != STEGO_TRANSFORM_LIFTING) return cache;
+
+    // Whole blocks in image order, as many as the memory bound allows
+    size_t block_bytes = (size_t)block_size * block_size * sizeof(int32_t);
+    int64_t blocks = (int64_t)(cover->width / block_size) * (cover->height / block_size);
+    if (max_bytes > 0 && (size_t)blocks > max_bytes / block_bytes) {
+        blocks = (int64_t)(max_bytes / block_bytes);
     }
+    if (blocks == 0) return cache;
 
-    // Calculate the embedding factor based on strength (1-10)
-    double embedding_factor = config->embedding_strength / 10.0;
-    
-    // Pre-calculate or store random block sequence if using randomization
-    int *block_sequence = NULL;
-    int total_blocks = blocks_x * blocks_y - 1; // minus the first metadata block
-    
-    if (config->use_random_blocks) {
-        // Allocate and initialize sequence
-        block_sequence = (int *)malloc(total_blocks * sizeof(int));
-        if (!block_sequence) {
-            free(cover_block);
-            free(stego->data);
-            free(stego);
-            return NULL;
-        }
-        
-        // Initialize with sequential order
-        for (int i = 0; i < total_blocks; i++) {
-            block_sequence[i] = i + 1; // +1 to skip first block
-        }
-        
-        // Fisher-Yates shuffle
-        for (int i = total_blocks - 1; i > 0; i--) {
-            int j = rand() % (i + 1);
-            // Swap
-            int temp = block_sequence[i];
-            block_sequence[i] = block_sequence[j];
-            block_sequence[j] = temp;
-        }
+    cache->coefficients = (int32_t *)pgm_alloc_pixels((size_t)blocks * block_bytes);
+    ThreadPool *pool = stego_context_pool(ctx);
+    if (!cache->coefficients || context_codecs(ctx, block_size, thread_pool_size(pool)) != 0) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Failed to allocate cover cache");
+        stego_cover_cache_free(cache);
+        return NULL;
     }
+    cache->cached_blocks = blocks;
 
-    // Iterate through secret image pixels and embed them
-    int secret_pixels = secret->width * secret->height;
-    int embedded_count = 0;
-    
-    while (embedded_count < secret_pixels && embedded_count < total_blocks) {
-        // Determine which block to use
-        int block_idx;
-        
-        if (config->use_random_blocks) {
-            block_idx = block_sequence[embedded_count]; 
-        } else {
-            block_idx = embedded_count + 1; // +1 to skip first block
-        }
-        
-        // Convert linear block index to 2D coordinates
-        int bx = block_idx % blocks_x;
-        int by = block_idx / blocks_x;
-        
-        // Calculate secret image pixel to embed
-        int secret_x = embedded_count % secret->width;
-        int secret_y = embedded_count / secret->width;
-        unsigned char pixel = secret->data[secret_y * secret->width + secret_x];
-        
-        // Copy current block data to double array
-        for (int i = 0; i < block_size; i++) {
-            for (int j = 0; j < block_size; j++) {
-                int cover_y = by * block_size + i;
-                int cover_x = bx * block_size + j;
-                
-                if (cover_y < stego->height && cover_x < stego->width) {
-                    cover_block[i * block_size + j] = stego->data[cover_y * stego->width + cover_x];
-                } else {
-                    cover_block[i * block_size + j] = 0;
-                }
-            }
-        }
+    // Chunks are whole tiles, so only the last chunk has a partial group
+    CacheJob job = { cover, ctx->codecs, cache };
+    thread_pool_parallel_for(pool, blocks, (int64_t)ctx->codecs[0].lanes * 64, cache_range, &job);
+    return cache;
+}
 
-        // Apply forward G-let D3 transform
-        glet_d3_forward(cover_block, block_size);
-
-        // Embed one pixel of secret image in high-frequency coefficients
-        // Embed 8 bits of the pixel into 8 different high-frequency coefficients
-        for (int bit = 0; bit < 8; bit++) {
-            // Select a high-frequency coefficient position (avoid low frequencies)
-            int coef_y = block_size / 2 + bit % 4;
-            int coef_x = block_size / 2 + bit / 4;
-            
-            // Extract the bit to embed
-            int pixel_bit = (pixel >> bit) & 1;
-            
-            // Modify the coefficient based on the bit and embedding factor
-            double coef_val = cover_block[coef_y * block_size + coef_x];
-            if (pixel_bit == 1) {
-                // For 1, make coefficient slightly more positive
-                cover_block[coef_y * block_size + coef_x] = coef_val + embedding_factor;
-            } else {
-                // For 0, make coefficient slightly more negative
-                cover_block[coef_y * block_size + coef_x] = coef_val - embedding_factor;
-            }
-        }
+/**
+ * Embed a secret image in place into a copy of a cached cover
+ */
+int stego_context_embed_cached(StegoContext *ctx, const StegoCoverCache *cache,
+                               const PGMImageView *stego, PGMImage *secret) {
+    if (!cache || !stego || stego->width != cache->width || stego->height != cache->height ||
+        resolve_block_size(ctx->config.block_size) != cache->block_size) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Cover cache does not match the image and configuration");
+        return -1;
+    }
 
-        // Apply inverse G-let D3 transform
-        glet_d3_inverse(cover_block, block_size);
-
-        // Copy modified block back to stego image
-        for (int i = 0; i < block_size; i++) {
-            for (int j = 0; j < block_size; j++) {
-                int cover_y = by * block_size + i;
-                int cover_x = bx * block_size + j;
-                
-                if (cover_y < stego->height && cover_x < stego->width) {
-                    stego->data[cover_y * stego->width + cover_x] = clip_to_byte(cover_block[i * block_size + j]);
-                }
-            }
-        }
-        
-        embedded_count++;
+    if (!stego->data || !secret || !secret->data || stego->stride < (size_t)stego->width) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Invalid input images");
+        return -1;
     }
 
-    // Free allocated memory
-    free(cover_block);
-    if (block_sequence) {
-        free(block_sequence);
+    // Verify that the secret image can fit in the cover image
+    if (stego->width < secret->width || stego->height < secret->height) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Secret image is larger than cover image");
+        return -1;
     }
-    
-    return stego;
+
+    return embed_payload_cached(ctx, stego, secret,
+                                ctx->config.transform == STEGO_TRANSFORM_LIFTING ? cache : NULL);
 }
 
 /**
- * Extract a secret PGM image from a stego image
+ * Resolve the block size and secret dimensions of an extraction
  */
-PGMImage* extract_image_with_config(PGMImage *stego, int width, int height, StegoConfig *config) {
-    if (!stego || !stego->data) {
-        fprintf(stderr, "Error: Invalid stego image\n");
-        return NULL;
-    }
+int extract_dimensions(StegoContext *ctx, const PGMImageView *stego, int *width, int *height) {
+    StegoConfig *config = &ctx->config;
 
-    // Use default config if none provided
-    StegoConfig default_config;
-    if (!config) {
-        default_config = create_default_config();
-        config = &default_config;
+    if (!stego || !stego->data || stego->stride < (size_t)stego->width) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Invalid stego image");
+        return -1;
     }
 
     // Determine block size from the stego image if not specified
-    int block_size = is_power_of_two(config->block_size) ? 
-                     config->block_size : next_power_of_two(config->block_size);
+    int block_size = resolve_block_size(config->block_size);
+
+    if (block_size < MIN_EMBED_BLOCK_SIZE) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Block size must be at least %d", MIN_EMBED_BLOCK_SIZE);
+        return -1;
+    }
 
     // If dimensions and config not provided, extract them from the first block
-    if (width <= 0 || height <= 0) {
-        double *first_block = (double *)malloc(block_size * block_size * sizeof(double));
-        if (!first_block) return NULL;
-
-        // Copy first block data to double array
-        for (int i = 0; i < block_size && i < stego->height; i++) {
-            for (int j = 0; j < block_size && j < stego->width; j++) {
-                first_block[i * block_size + j] = stego->data[i * stego->width + j];
-            }
-        }
+    if (*width <= 0 || *height <= 0) {
+        if (read_metadata_block(stego, block_size, config, width, height) != 0) return -1;
 
-        // Apply forward G-let D3 transform
-        glet_d3_forward(first_block, block_size);
+        // Update block size from extracted config
+        block_size = resolve_block_size(config->block_size);
 
-        // Extract secret image dimensions and configuration from high-frequency coefficients
-        width = (int)first_block[block_size * (block_size / 2) + block_size / 2 + 1];
-        height = (int)first_block[block_size * (block_size / 2 + 1) + block_size / 2];
-        config->block_size = (int)first_block[block_size * (block_size / 2 + 2) + block_size / 2];
-        config->embedding_strength = (int)first_block[block_size * (block_size / 2 + 3) + block_size / 2];
-        config->use_random_blocks = (int)first_block[block_size * (block_size / 2 + 4) + block_size / 2];
+        if (block_size < MIN_EMBED_BLOCK_SIZE) {
+            stego_log(ctx, STEGO_LOG_ERROR, "Invalid block size extracted: %d", config->block_size);
+            return -1;
+        }
 
-        free(first_block);
-        
-        // Update block size from extracted config
-        block_size = is_power_of_two(config->block_size) ? 
-                     config->block_size : next_power_of_two(config->block_size);
+        stego_log(ctx, STEGO_LOG_INFO, "Detected block size %d, strength %d, %s blocks",
+                  config->block_size, config->embedding_strength,
+                  config->use_random_blocks ? "random" : "sequential");
     }
 
     // Verify extracted dimensions
-    if (width <= 0 || height <= 0 || width > stego->width || height > stego->height) {
-        fprintf(stderr, "Error: Invalid secret image dimensions extracted: %dx%d\n", width, height);
-        return NULL;
+    if (*width <= 0 || *height <= 0 || *width > stego->width || *height > stego->height) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Invalid secret image dimensions extracted: %dx%d", *width, *height);
+        return -1;
+    }
+
+    return block_size;
+}
+
+/**
+ * Extract the secret pixels into a caller buffer of width * height bytes
+ */
+int extract_payload(StegoContext *ctx, const PGMImageView *stego, int block_size,
+                    int width, int height, unsigned char *secret) {
+    int64_t secret_pixels = (int64_t)width * height;
+
+    // Pixels beyond the cover's capacity stay zero
+    memset(secret, 0, (size_t)secret_pixels);
+
+    // Process each block (skip the first block which contains metadata),
+    // projecting its pixels onto the 8 payload coefficients
+    PayloadEngine engine;
+    if (payload_engine_init(&engine, ctx, block_size, stego->width, stego->height, secret_pixels, 0) != 0) {
+        return -1;
     }
 
-    printf("Detected steganography configuration:\n");
-    printf("Block size: %d\n", config->block_size);
-    printf("Embedding strength: %d\n", config->embedding_strength);
-    printf("Using random blocks: %s\n", config->use_random_blocks ? "Yes" : "No");
+    payload_engine_extract_image(&engine, stego, secret);
+    payload_engine_free(&engine);
+    return 0;
+}
+
+/**
+ * Extract a secret image from pixels owned by the caller
+ */
+PGMImage* stego_context_extract(StegoContext *ctx, const PGMImageView *stego, int width, int height) {
+    int block_size = extract_dimensions(ctx, stego, &width, &height);
+    if (block_size < 0) return NULL;
 
     // Create the secret image
-    PGMImage *secret = (PGMImage *)malloc(sizeof(PGMImage));
+    PGMImage *secret = (PGMImage *)calloc(1, sizeof(PGMImage));
     if (!secret) return NULL;
 
     secret->width = width;
     secret->height = height;
-    secret->max_gray = stego->max_gray;
-    secret->data = (unsigned char *)malloc(secret->width * secret->height * sizeof(unsigned char));
+    secret->max_gray = 255;
+    secret->data = pgm_alloc_pixels((size_t)secret->width * secret->height);
     
     if (!secret->data) {
         free(secret);
         return NULL;
     }
 
-    // Initialize the secret image data to zeros
-    memset(secret->data, 0, secret->width * secret->height * sizeof(unsigned char));
+    if (extract_payload(ctx, stego, block_size, width, height, secret->data) != 0) {
+        free_pgm(secret);
+        return NULL;
+    }
+
+    return secret;
+}
 
-    // Calculate the number of blocks in the stego image
-    int blocks_x = stego->width / block_size;
-    int blocks_y = stego->height / block_size;
+/**
+ * Extract a rectangle of a secret image, decoding only the blocks that carry it
+ */
+PGMImage* stego_context_extract_region(StegoContext *ctx, const PGMImageView *stego, int width, int height,
+                                       const StegoRegion *region) {
+    int block_size = extract_dimensions(ctx, stego, &width, &height);
+    if (block_size < 0) return NULL;
 
-    // Set random seed if using random blocks
-    if (config->use_random_blocks) {
-        srand(config->random_seed);
+    if (!region || region->x < 0 || region->y < 0 || region->width <= 0 || region->height <= 0 ||
+        region->x > width - region->width || region->y > height - region->height) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Region does not lie inside the %dx%d secret image", width, height);
+        return NULL;
     }
 
-    // Pre-calculate or store random block sequence if using randomization
-    int *block_sequence = NULL;
-    int total_blocks = blocks_x * blocks_y - 1; // minus the first metadata block
-    
-    if (config->use_random_blocks) {
-        // Allocate and initialize sequence
-        block_sequence = (int *)malloc(total_blocks * sizeof(int));
-        if (!block_sequence) {
-            free(secret->data);
-            free(secret);
-            return NULL;
-        }
-        
-        // Initialize with sequential order
-        for (int i = 0; i < total_blocks; i++) {
-            block_sequence[i] = i + 1; // +1 to skip first block
-        }
-        
-        // Fisher-Yates shuffle with same seed used during embedding
-        for (int i = total_blocks - 1; i > 0; i--) {
-            int j = rand() % (i + 1);
-            // Swap
-            int temp = block_sequence[i];
-            block_sequence[i] = block_sequence[j];
-            block_sequence[j] = temp;
-        }
+    PGMImage *secret = (PGMImage *)calloc(1, sizeof(PGMImage));
+    if (!secret) return NULL;
+
+    secret->width = region->width;
+    secret->height = region->height;
+    secret->max_gray = 255;
+    secret->data = pgm_alloc_pixels((size_t)secret->width * secret->height);
+
+    PayloadEngine engine;
+    if (!secret->data || payload_engine_init(&engine, ctx, block_size, stego->width, stego->height,
+                                             (int64_t)width * height, 0) != 0) {
+        free_pgm(secret);
+        return NULL;
     }
 
-    // Process each block (skip the first block which contains metadata)
-    double *stego_block = (double *)malloc(block_size * block_size * sizeof(double));
-    if (!stego_block) {
-        if (block_sequence) free(block_sequence);
-        free(secret->data);
-        free(secret);
+    payload_engine_extract_region(&engine, stego, width, region, secret->data);
+    payload_engine_free(&engine);
+    return secret;
+}
+
+/**
+ * Embed a secret PGM image into a cover PGM image using G-let D3 steganography
+ */
+PGMImage* embed_image_with_config(PGMImage *cover, PGMImage *secret, StegoConfig *config) {
+    return embed_image_with_report(cover, secret, config, NULL);
+}
+
+/**
+ * Embed a secret PGM image into a cover PGM image and report the quality of the result
+ */
+PGMImage* embed_image_with_report(PGMImage *cover, PGMImage *secret, StegoConfig *config,
+                                  StegoEmbedReport *report) {
+    if (!cover || !secret || !cover->data || !secret->data) {
+        fprintf(stderr, "Error: Invalid input images\n");
         return NULL;
     }
 
-    // Calculate the embedding factor based on strength (1-10)
-    double embedding_factor = config->embedding_strength / 10.0;
+    // Create a copy of the cover image
+    PGMImage *stego = (PGMImage *)calloc(1, sizeof(PGMImage));
+    if (!stego) return NULL;
 
-    // Iterate through secret image pixels and extract them
-    int secret_pixels = secret->width * secret->height;
-    int extracted_count = 0;
+    stego->width = cover->width;
+    stego->height = cover->height;
+    stego->max_gray = cover->max_gray;
+    stego->data = pgm_alloc_pixels((size_t)stego->width * stego->height);
     
-    while (extracted_count < secret_pixels && extracted_count < total_blocks) {
-        // Determine which block to use
-        int block_idx;
-        
-        if (config->use_random_blocks) {
-            block_idx = block_sequence[extracted_count]; 
-        } else {
-            block_idx = extracted_count + 1; // +1 to skip first block
-        }
-        
-        // Convert linear block index to 2D coordinates
-        int bx = block_idx % blocks_x;
-        int by = block_idx / blocks_x;
-        
-        // Calculate secret image pixel position
-        int secret_x = extracted_count % secret->width;
-        int secret_y = extracted_count / secret->width;
-        
-        // Copy current block data to double array
-        for (int i = 0; i < block_size; i++) {
-            for (int j = 0; j < block_size; j++) {
-                int stego_y = by * block_size + i;
-                int stego_x = bx * block_size + j;
-                
-                if (stego_y < stego->height && stego_x < stego->width) {
-                    stego_block[i * block_size + j] = stego->data[stego_y * stego->width + stego_x];
-                } else {
-                    stego_block[i * block_size + j] = 0;
-                }
-            }
-        }
+    if (!stego->data) {
+        free(stego);
+        return NULL;
+    }
 
-        // Apply forward G-let D3 transform
-        glet_d3_forward(stego_block, block_size);
-
-        // Extract one pixel of secret image from high-frequency coefficients
-        unsigned char pixel = 0;
-        
-        // Extract 8 bits of the pixel from 8 different high-frequency coefficients
-        for (int bit = 0; bit < 8; bit++) {
-            // Select the same high-frequency coefficient position used during embedding
-            int coef_y = block_size / 2 + bit % 4;
-            int coef_x = block_size / 2 + bit / 4;
-            
-            // Extract the bit based on the sign of the coefficient
-            double coef_val = stego_block[coef_y * block_size + coef_x];
-            int pixel_bit = (coef_val >= 0) ? 1 : 0;
-            
-            // Add the bit to the pixel
-            pixel |= (pixel_bit << bit);
-        }
-        
-        // Store the extracted pixel
-        secret->data[secret_y * secret->width + secret_x] = pixel;
-        
-        extracted_count++;
+    // Copy cover image data
+    memcpy(stego->data, cover->data, (size_t)stego->width * stego->height);
+
+    StegoContext *ctx = stego_context_create(config);
+    if (!ctx) {
+        free_pgm(stego);
+        return NULL;
     }
 
-    // Free allocated memory
-    free(stego_block);
-    if (block_sequence) {
-        free(block_sequence);
+    PGMImageView view = pgm_image_view(stego);
+    stego_context_set_embed_report(ctx, report);
+    int status = stego_context_embed(ctx, &view, secret);
+    stego_context_destroy(ctx);
+
+    if (status != 0) {
+        free_pgm(stego);
+        return NULL;
     }
-    
+
+    return stego;
+}
+
+/**
+ * Embed a secret image in place into pixels owned by the caller, through a
+ * context that lives for this call only
+ */
+int embed_image_view(const PGMImageView *cover, PGMImage *secret, StegoConfig *config) {
+    StegoContext *ctx = stego_context_create(config);
+    if (!ctx) return -1;
+
+    int status = stego_context_embed(ctx, cover, secret);
+    stego_context_destroy(ctx);
+    return status;
+}
+
+/**
+ * Extract a secret image from pixels owned by the caller, through a context
+ * that lives for this call only
+ */
+PGMImage* extract_image_view(const PGMImageView *stego, int width, int height, StegoConfig *config) {
+    StegoContext *ctx = stego_context_create(config);
+    if (!ctx) return NULL;
+
+    PGMImage *secret = stego_context_extract(ctx, stego, width, height);
+
+    // Hand the detected configuration back to the caller
+    if (config) *config = ctx->config;
+
+    stego_context_destroy(ctx);
+    return secret;
+}
+
+/**
+ * Extract a rectangle of a secret PGM image from a stego image, through a
+ * context that lives for this call only
+ */
+PGMImage* extract_region_with_config(PGMImage *stego, int width, int height, const StegoRegion *region,
+                                     StegoConfig *config) {
+    if (!stego || !stego->data) {
+        fprintf(stderr, "Error: Invalid stego image\n");
+        return NULL;
+    }
+
+    StegoContext *ctx = stego_context_create(config);
+    if (!ctx) return NULL;
+
+    PGMImageView view = pgm_image_view(stego);
+    PGMImage *secret = stego_context_extract_region(ctx, &view, width, height, region);
+    if (secret) {
+        secret->max_gray = stego->max_gray;
+    }
+
+    // Hand the detected configuration back to the caller
+    if (config) *config = ctx->config;
+
+    stego_context_destroy(ctx);
+    return secret;
+}
+
+/**
+ * Extract a secret PGM image from a stego image
+ */
+PGMImage* extract_image_with_config(PGMImage *stego, int width, int height, StegoConfig *config) {
+    if (!stego || !stego->data) {
+        fprintf(stderr, "Error: Invalid stego image\n");
+        return NULL;
+    }
+
+    PGMImageView view = pgm_image_view(stego);
+    PGMImage *secret = extract_image_view(&view, width, height, config);
+    if (secret) {
+        secret->max_gray = stego->max_gray;
+    }
+
     return secret;
-} 
\ No newline at end of file
+}
\ No newline at end of file
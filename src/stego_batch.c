@@ -0,0 +1,872 @@
+/**
+ * stego_batch.c
+ * Batch mode: many embed/extract/assess jobs in one process
+ *
+ * Every job runs on one worker of a work-stealing pool. A worker keeps one
+ * context for all of its jobs, so transform scratch and the extraction
+ * buffer are allocated once per worker rather than once per job. Jobs are
+ * queued largest input first and idle workers steal from busy ones, so a
+ * few huge covers do not leave the other workers waiting. Since jobs run in
+ * no fixed order, a job that reads another job's output fails up front.
+ *
+ * The pipelined mode instead runs jobs in manifest order through three
+ * stages: a reader thread loads the inputs of the next jobs, the calling
+ * thread transforms the current one on all workers, and a writer thread
+ * saves the previous ones. Bounded queues between the stages keep at most a
+ * few jobs' images in memory. A job that reads the output of an earlier job
+ * is only loaded once the writer has saved that output.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "stego_internal.h"
+#include "../include/spsc_queue.h"
+
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+/**
+ * Longest manifest line, and longest message kept for the report
+ */
+#define BATCH_LINE_MAX 4096
+#define BATCH_MESSAGE_MAX 256
+
+/**
+ * Jobs waiting between two pipeline stages: one being handed over while the
+ * next is prepared
+ */
+#define BATCH_PIPELINE_DEPTH 2
+
+typedef enum {
+    BATCH_INVALID,
+    BATCH_EMBED,
+    BATCH_EXTRACT,
+    BATCH_ASSESS
+} BatchOperation;
+
+/**
+ * Identity of a file named in a manifest. A file that exists is its device
+ * and inode; one a job has yet to write is its directory's, plus its name.
+ * Without inode numbers (Windows) the path alone identifies the file.
+ */
+typedef struct {
+    int exists;
+    dev_t dev;
+    ino_t ino;
+    const char *name;           // File name, or the whole path on Windows (NULL when it exists)
+} BatchFileId;
+
+/**
+ * One manifest line and, once run, its result
+ */
+typedef struct {
+    int line;                   // Manifest line number
+    BatchOperation operation;
+    char *text;                 // Copy of the line; files point into it
+    const char *files[3];
+    int width, height;          // Extraction dimensions (0 to read them from the image)
+    StegoConfig config;
+    double cost;                // Input size in bytes, for ordering
+
+    int status;
+    int worker;
+    double seconds;
+    int result_width, result_height;
+    double mse, psnr, ssim;
+    char message[BATCH_MESSAGE_MAX];
+    BatchFileId ids[3];         // Identity of each file, taken before any job runs
+
+    // Pipelined mode only: images passed between the stages
+    double started;
+    PGMImage *inputs[2];
+    PGMImage *output;
+} BatchJob;
+
+/**
+ * Per-worker state reused across jobs
+ */
+typedef struct {
+    StegoContext *ctx;
+    char error[BATCH_MESSAGE_MAX];  // First error of the current job
+} BatchWorker;
+
+typedef struct {
+    BatchJob **order;           // Jobs by decreasing cost
+    BatchWorker *workers;
+} BatchRun;
+
+/**
+ * Monotonic time in seconds
+ */
+static double batch_seconds(void) {
+#ifdef _WIN32
+    return (double)clock() / CLOCKS_PER_SEC;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+/**
+ * Log callback keeping the first error of a job for the report
+ */
+static void batch_log(void *user, StegoLogLevel level, const char *message) {
+    BatchWorker *worker = (BatchWorker *)user;
+    if (level == STEGO_LOG_ERROR && worker->error[0] == '\0') {
+        snprintf(worker->error, sizeof(worker->error), "%s", message);
+    }
+}
+
+/**
+ * Split off the next whitespace-separated token of a line
+ * @return Token, or NULL at the end of the line
+ */
+static char* next_token(char **cursor) {
+    char *p = *cursor;
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+    if (*p == '\0') return NULL;
+
+    char *token = p;
+    while (*p && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') p++;
+    if (*p) *p++ = '\0';
+
+    *cursor = p;
+    return token;
+}
+
+/**
+ * Parse a manifest line into a job
+ * @return 0 on success, -1 (with job->message set) on failure
+ */
+static int parse_job(BatchJob *job) {
+    static const struct { const char *name; BatchOperation operation; int files; } operations[] = {
+        { "embed", BATCH_EMBED, 3 },
+        { "extract", BATCH_EXTRACT, 2 },
+        { "assess", BATCH_ASSESS, 2 }
+    };
+
+    char *cursor = job->text;
+    const char *name = next_token(&cursor);
+    int files = 0;
+
+    for (size_t i = 0; i < sizeof(operations) / sizeof(operations[0]); i++) {
+        if (strcmp(name, operations[i].name) == 0) {
+            job->operation = operations[i].operation;
+            files = operations[i].files;
+        }
+    }
+    if (job->operation == BATCH_INVALID) {
+        snprintf(job->message, sizeof(job->message), "Unknown operation '%s'", name);
+        return -1;
+    }
+
+    for (int i = 0; i < files; i++) {
+        job->files[i] = next_token(&cursor);
+        if (!job->files[i]) {
+            snprintf(job->message, sizeof(job->message), "%s requires %d file arguments", name, files);
+            job->operation = BATCH_INVALID;
+            return -1;
+        }
+    }
+
+    // Optional extraction dimensions, then the per-job options
+    char *token = next_token(&cursor);
+    if (job->operation == BATCH_EXTRACT && token && token[0] != '-') {
+        const char *height = next_token(&cursor);
+        job->width = atoi(token);
+        job->height = height ? atoi(height) : 0;
+        token = next_token(&cursor);
+    }
+
+    for (; token; token = next_token(&cursor)) {
+        const char *value = NULL;
+        if (strcmp(token, "-b") == 0 || strcmp(token, "-s") == 0 || strcmp(token, "-seed") == 0) {
+            value = next_token(&cursor);
+            if (!value) break;
+        }
+
+        if (strcmp(token, "-b") == 0) {
+            job->config.block_size = atoi(value);
+        } else if (strcmp(token, "-s") == 0) {
+            job->config.embedding_strength = atoi(value);
+        } else if (strcmp(token, "-seed") == 0) {
+            job->config.random_seed = strtoul(value, NULL, 10);
+        } else if (strcmp(token, "-r") == 0) {
+            job->config.use_random_blocks = 1;
+        } else if (strcmp(token, "-l") == 0) {
+            job->config.transform = STEGO_TRANSFORM_LIFTING;
+        }
+    }
+
+    if (token) {
+        snprintf(job->message, sizeof(job->message), "Option %s requires a value", token);
+        job->operation = BATCH_INVALID;
+        return -1;
+    }
+
+    struct stat info;
+    job->cost = stat(job->files[0], &info) == 0 ? (double)info.st_size : 0.0;
+    return 0;
+}
+
+/**
+ * Embed job: cover, secret, output
+ */
+static int batch_embed(StegoContext *ctx, BatchJob *job) {
+    PGMImage *cover = load_pgm_mapped(job->files[0]);
+    PGMImage *secret = cover ? load_pgm_mapped(job->files[1]) : NULL;
+    int status = -1;
+
+    if (!secret) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Cannot load %s", cover ? job->files[1] : job->files[0]);
+    } else {
+        status = stego_context_embed_file(ctx, cover, secret, job->files[2]);
+        job->result_width = secret->width;
+        job->result_height = secret->height;
+    }
+
+    free_pgm(secret);
+    free_pgm(cover);
+    return status;
+}
+
+/**
+ * Extract job: stego, output; the secret is decoded into the worker's arena
+ */
+static int batch_extract(StegoContext *ctx, BatchJob *job) {
+    PGMImage *stego = load_pgm_mapped(job->files[0]);
+    if (!stego) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Cannot load %s", job->files[0]);
+        return -1;
+    }
+
+    PGMImageView view = pgm_image_view(stego);
+    int width = job->width;
+    int height = job->height;
+    int status = -1;
+
+    int block_size = extract_dimensions(ctx, &view, &width, &height);
+    if (block_size > 0) {
+        unsigned char *pixels = stego_context_arena(ctx, (size_t)width * height);
+
+        if (!pixels) {
+            stego_log(ctx, STEGO_LOG_ERROR, "Failed to allocate %dx%d secret image", width, height);
+        } else if (extract_payload(ctx, &view, block_size, width, height, pixels) == 0) {
+            PGMImage secret = { width, height, stego->max_gray, pixels, NULL, 0 };
+            status = save_pgm(&secret, job->files[1]);
+            if (status != 0) stego_log(ctx, STEGO_LOG_ERROR, "Cannot save %s", job->files[1]);
+        }
+
+        job->result_width = width;
+        job->result_height = height;
+    }
+
+    free_pgm(stego);
+    return status;
+}
+
+/**
+ * Assess job: original, modified
+ */
+static int batch_assess(StegoContext *ctx, BatchJob *job) {
+    PGMImage *original = load_pgm_mapped(job->files[0]);
+    PGMImage *modified = original ? load_pgm_mapped(job->files[1]) : NULL;
+    int status = -1;
+
+    if (!modified) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Cannot load %s", original ? job->files[1] : job->files[0]);
+    } else {
+        StegoQualityMetrics metrics;
+        if (stego_context_quality_metrics(ctx, original, modified, &metrics) != 0) {
+            stego_log(ctx, STEGO_LOG_ERROR, "Image dimensions do not match");
+        } else {
+            job->mse = metrics.mse;
+            job->psnr = metrics.psnr;
+            job->ssim = metrics.ssim;
+            job->result_width = original->width;
+            job->result_height = original->height;
+            status = 0;
+        }
+    }
+
+    free_pgm(modified);
+    free_pgm(original);
+    return status;
+}
+
+/**
+ * Task callback: run one job on the calling worker
+ */
+static void run_job(void *arg, int64_t begin, int64_t end, int worker) {
+    BatchRun *run = (BatchRun *)arg;
+    BatchJob *job = run->order[begin];
+    BatchWorker *state = &run->workers[worker];
+    StegoContext *ctx = state->ctx;
+    (void)end;
+
+    double start = batch_seconds();
+    state->error[0] = '\0';
+
+    ctx->config = job->config;
+
+    switch (job->operation) {
+        case BATCH_EMBED:   job->status = batch_embed(ctx, job); break;
+        case BATCH_EXTRACT: job->status = batch_extract(ctx, job); break;
+        case BATCH_ASSESS:  job->status = batch_assess(ctx, job); break;
+        default:            job->status = -1; break;
+    }
+
+    job->worker = worker;
+    job->seconds = batch_seconds() - start;
+    if (job->status != 0) {
+        snprintf(job->message, sizeof(job->message), "%s", state->error[0] ? state->error : "Failed");
+    }
+}
+
+/**
+ * Order jobs by decreasing cost, then by manifest line
+ */
+static int compare_cost(const void *a, const void *b) {
+    const BatchJob *x = *(BatchJob * const *)a;
+    const BatchJob *y = *(BatchJob * const *)b;
+    if (x->cost != y->cost) return x->cost < y->cost ? 1 : -1;
+    return x->line - y->line;
+}
+
+/**
+ * Write one report row per job, in manifest order
+ */
+static void write_report(FILE *report, const BatchJob *jobs, int count) {
+    static const char *names[] = { "invalid", "embed", "extract", "assess" };
+
+    fprintf(report, "line\toperation\tstatus\tworker\tseconds\twidth\theight\tmse\tpsnr\tssim\tmessage\n");
+
+    for (int i = 0; i < count; i++) {
+        const BatchJob *job = &jobs[i];
+        fprintf(report, "%d\t%s\t%s\t%d\t%.6f\t", job->line, names[job->operation],
+                job->status == 0 ? "ok" : "error", job->worker, job->seconds);
+
+        if (job->result_width > 0) {
+            fprintf(report, "%d\t%d\t", job->result_width, job->result_height);
+        } else {
+            fprintf(report, "\t\t");
+        }
+
+        if (job->operation == BATCH_ASSESS && job->status == 0) {
+            fprintf(report, "%.6f\t%.4f\t%.6f\t", job->mse, job->psnr, job->ssim);
+        } else {
+            fprintf(report, "\t\t\t");
+        }
+
+        // Keep the message on one field
+        for (const char *c = job->message; *c; c++) {
+            fputc(*c == '\t' || *c == '\n' ? ' ' : *c, report);
+        }
+        fputc('\n', report);
+    }
+}
+
+/**
+ * Read every job of a manifest
+ * @return Number of jobs, or -1 on failure
+ */
+static int read_manifest(const char *manifest_file, const StegoConfig *defaults, BatchJob **jobs_out) {
+    FILE *manifest = fopen(manifest_file, "r");
+    if (!manifest) {
+        fprintf(stderr, "Error: Cannot open file %s\n", manifest_file);
+        return -1;
+    }
+
+    BatchJob *jobs = NULL;
+    int count = 0, capacity = 0;
+    char line[BATCH_LINE_MAX];
+    int number = 0;
+
+    while (fgets(line, sizeof(line), manifest)) {
+        number++;
+
+        // Skip blank lines and comments
+        char *p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '\0' || *p == '\n' || *p == '\r' || *p == '#') continue;
+
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            BatchJob *grown = (BatchJob *)realloc(jobs, capacity * sizeof(BatchJob));
+            if (!grown) break;
+            jobs = grown;
+        }
+
+        BatchJob *job = &jobs[count];
+        memset(job, 0, sizeof(BatchJob));
+        job->line = number;
+        job->config = *defaults;
+        job->config.num_threads = 1;    // Parallelism comes from running jobs side by side
+        job->status = -1;
+        job->worker = -1;
+
+        size_t length = strlen(p);
+        job->text = (char *)malloc(length + 1);
+        if (!job->text) break;
+        memcpy(job->text, p, length + 1);
+        count++;
+
+        if (length > 0 && p[length - 1] != '\n' && !feof(manifest)) {
+            snprintf(job->message, sizeof(job->message), "Line longer than %d characters", BATCH_LINE_MAX - 2);
+            // Drop the rest of the line
+            int c;
+            while ((c = fgetc(manifest)) != EOF && c != '\n');
+            continue;
+        }
+
+        parse_job(job);
+    }
+
+    int failed = ferror(manifest) || !feof(manifest);
+    fclose(manifest);
+
+    if (failed) {
+        fprintf(stderr, "Error: Failed to read manifest %s\n", manifest_file);
+        for (int i = 0; i < count; i++) free(jobs[i].text);
+        free(jobs);
+        return -1;
+    }
+
+    *jobs_out = jobs;
+    return count;
+}
+
+/**
+ * Number of input files of a job
+ */
+static int batch_input_count(const BatchJob *job) {
+    return job->operation == BATCH_EMBED || job->operation == BATCH_ASSESS ? 2 : 1;
+}
+
+/**
+ * Index in files of a job's output (-1 for an assessment)
+ */
+static int batch_output_index(const BatchJob *job) {
+    switch (job->operation) {
+        case BATCH_EMBED:   return 2;
+        case BATCH_EXTRACT: return 1;
+        default:            return -1;
+    }
+}
+
+/**
+ * Take the identity of a file
+ */
+static void batch_file_id(const char *path, BatchFileId *id) {
+    memset(id, 0, sizeof(BatchFileId));
+#ifdef _WIN32
+    id->name = path;
+#else
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        id->exists = 1;
+        id->dev = st.st_dev;
+        id->ino = st.st_ino;
+        return;
+    }
+
+    // Not written yet: its directory (a path without one is in ".")
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+    char dir[BATCH_LINE_MAX];
+    snprintf(dir, sizeof(dir), "%.*s", name > path ? (int)(name - path) : 1, name > path ? path : ".");
+    id->name = name;
+    if (stat(dir, &st) == 0) {
+        id->dev = st.st_dev;
+        id->ino = st.st_ino;
+    }
+#endif
+}
+
+/**
+ * Check whether two identities name the same file
+ */
+static int batch_same_file(const BatchFileId *a, const BatchFileId *b) {
+    if (a->exists != b->exists || a->dev != b->dev || a->ino != b->ino) return 0;
+    return a->exists || strcmp(a->name, b->name) == 0;
+}
+
+/**
+ * Identify the files of every valid job, all before the first job runs
+ */
+static void batch_identify_files(BatchJob *jobs, int count) {
+    for (int i = 0; i < count; i++) {
+        BatchJob *job = &jobs[i];
+        if (job->operation == BATCH_INVALID) continue;
+
+        for (int k = 0; k < batch_input_count(job); k++) batch_file_id(job->files[k], &job->ids[k]);
+        int output = batch_output_index(job);
+        if (output >= 0) batch_file_id(job->files[output], &job->ids[output]);
+    }
+}
+
+/**
+ * Latest job of jobs[begin, end) whose output is the input `input` of `job`
+ * @return Its position in jobs, or -1 if none writes it
+ */
+static int batch_writer(BatchJob *const *jobs, int begin, int end, const BatchJob *job, int input) {
+    for (int k = end - 1; k >= begin; k--) {
+        int output = batch_output_index(jobs[k]);
+        if (output >= 0 && jobs[k] != job && batch_same_file(&jobs[k]->ids[output], &job->ids[input])) return k;
+    }
+    return -1;
+}
+
+/**
+ * Run a manifest of embed/extract/assess jobs and write a report
+ */
+int stego_batch_run(const char *manifest_file, FILE *report, const StegoConfig *defaults, int num_threads) {
+    StegoConfig default_config;
+    if (!defaults) {
+        default_config = create_default_config();
+        defaults = &default_config;
+    }
+
+    BatchJob *jobs = NULL;
+    int count = read_manifest(manifest_file, defaults, &jobs);
+    if (count < 0) return -1;
+
+    ThreadPool *pool = num_threads != 1 ? thread_pool_create(num_threads) : NULL;
+    int num_workers = thread_pool_size(pool);
+
+    BatchRun run;
+    run.order = (BatchJob **)malloc((count > 0 ? count : 1) * sizeof(BatchJob *));
+    run.workers = (BatchWorker *)calloc(num_workers, sizeof(BatchWorker));
+
+    int ready = run.order && run.workers;
+    for (int i = 0; ready && i < num_workers; i++) {
+        run.workers[i].ctx = stego_context_create(defaults);
+        if (!run.workers[i].ctx) {
+            ready = 0;
+            break;
+        }
+        stego_context_set_log(run.workers[i].ctx, batch_log, &run.workers[i]);
+    }
+
+    int failed = -1;
+    if (ready) {
+        int valid = 0;
+        for (int i = 0; i < count; i++) {
+            if (jobs[i].operation != BATCH_INVALID) run.order[valid++] = &jobs[i];
+        }
+
+        // Jobs run side by side in any order, so a job that reads another
+        // job's output could see it missing or half written. Such jobs fail
+        // up front; the pipeline runs them in manifest order instead.
+        batch_identify_files(jobs, count);
+        for (int i = 0; i < valid; i++) {
+            BatchJob *job = run.order[i];
+            for (int k = 0; k < batch_input_count(job); k++) {
+                int writer = batch_writer(run.order, 0, valid, job, k);
+                if (writer >= 0) {
+                    snprintf(job->message, sizeof(job->message),
+                             "Reads the output of line %d; use --pipeline", run.order[writer]->line);
+                    break;
+                }
+            }
+        }
+        int scheduled = 0;
+        for (int i = 0; i < valid; i++) {
+            if (!run.order[i]->message[0]) run.order[scheduled++] = run.order[i];
+        }
+
+        // Largest first
+        qsort(run.order, scheduled, sizeof(BatchJob *), compare_cost);
+
+        thread_pool_run_tasks(pool, scheduled, run_job, &run);
+
+        write_report(report, jobs, count);
+        failed = 0;
+        for (int i = 0; i < count; i++) {
+            if (jobs[i].status != 0) failed++;
+        }
+    } else {
+        fprintf(stderr, "Error: Failed to allocate batch workers\n");
+    }
+
+    for (int i = 0; run.workers && i < num_workers; i++) {
+        stego_context_destroy(run.workers[i].ctx);
+    }
+    for (int i = 0; i < count; i++) free(jobs[i].text);
+    free(run.workers);
+    free(run.order);
+    free(jobs);
+    thread_pool_destroy(pool);
+    return failed;
+}
+
+/**
+ * Pipeline stage 1: read every input of a job into memory
+ */
+static void pipeline_load(BatchJob *job) {
+    int count = batch_input_count(job);
+    job->started = batch_seconds();
+
+    for (int i = 0; i < count; i++) {
+        job->inputs[i] = load_pgm(job->files[i]);
+        if (!job->inputs[i]) {
+            snprintf(job->message, sizeof(job->message), "Cannot load %s", job->files[i]);
+            return;
+        }
+    }
+}
+
+/**
+ * Pipeline stage 2: embed, extract or assess in memory
+ * @return 0 on success, -1 on failure
+ */
+static int pipeline_transform(StegoContext *ctx, BatchJob *job) {
+    PGMImage *first = job->inputs[0];
+    PGMImage *second = job->inputs[1];
+    PGMImageView view = pgm_image_view(first);
+
+    switch (job->operation) {
+        case BATCH_EMBED:
+            // Embed in place; the loaded cover becomes the output
+            if (stego_context_embed(ctx, &view, second) != 0) return -1;
+            job->output = first;
+            job->inputs[0] = NULL;
+            job->result_width = second->width;
+            job->result_height = second->height;
+            return 0;
+
+        case BATCH_EXTRACT:
+            job->output = stego_context_extract(ctx, &view, job->width, job->height);
+            if (!job->output) return -1;
+            job->output->max_gray = first->max_gray;
+            job->result_width = job->output->width;
+            job->result_height = job->output->height;
+            return 0;
+
+        case BATCH_ASSESS: {
+            StegoQualityMetrics metrics;
+            if (stego_context_quality_metrics(ctx, first, second, &metrics) != 0) {
+                stego_log(ctx, STEGO_LOG_ERROR, "Image dimensions do not match");
+                return -1;
+            }
+            job->mse = metrics.mse;
+            job->psnr = metrics.psnr;
+            job->ssim = metrics.ssim;
+            job->result_width = first->width;
+            job->result_height = first->height;
+            return 0;
+        }
+
+        default:
+            return -1;
+    }
+}
+
+/**
+ * Pipeline stage 3: write the job's output and release its images
+ */
+static void pipeline_save(BatchJob *job) {
+    if (job->output) {
+        const char *output_file = job->files[batch_output_index(job)];
+        if (save_pgm(job->output, output_file) != 0) {
+            snprintf(job->message, sizeof(job->message), "Cannot save %s", output_file);
+            job->status = -1;
+        }
+    }
+
+    free_pgm(job->output);
+    free_pgm(job->inputs[0]);
+    free_pgm(job->inputs[1]);
+    job->output = job->inputs[0] = job->inputs[1] = NULL;
+
+    job->seconds = batch_seconds() - job->started;
+}
+
+typedef struct {
+    BatchJob **jobs;            // Scheduled jobs in manifest order
+    int count;
+    SpscQueue *loaded;          // Reader -> transform
+    SpscQueue *transformed;     // Transform -> writer
+#ifndef _WIN32
+    pthread_mutex_t lock;
+    pthread_cond_t saved_cond;  // Signalled whenever a job has been saved
+    int saved;                  // Jobs saved so far (a prefix of jobs)
+#endif
+} BatchPipeline;
+
+#ifndef _WIN32
+/**
+ * Latest earlier job whose output is an input of job `index`
+ * @return Its position in the pipeline, or -1 if the job depends on none
+ */
+static int pipeline_dependency(const BatchPipeline *pipeline, int index) {
+    const BatchJob *job = pipeline->jobs[index];
+    int latest = -1;
+
+    for (int i = 0; i < batch_input_count(job); i++) {
+        int writer = batch_writer(pipeline->jobs, 0, index, job, i);
+        if (writer > latest) latest = writer;
+    }
+    return latest;
+}
+
+/**
+ * Save a job and let a reader waiting for it continue
+ */
+static void pipeline_save_next(BatchPipeline *pipeline, BatchJob *job) {
+    pipeline_save(job);
+
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->saved++;
+    pthread_cond_broadcast(&pipeline->saved_cond);
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+/**
+ * Reader thread: load jobs in order, then queue NULL. A job that reads an
+ * earlier job's output waits until the writer has saved it; the jobs in
+ * between are already queued, so the writer always gets there.
+ */
+static void *pipeline_reader(void *data) {
+    BatchPipeline *pipeline = (BatchPipeline *)data;
+
+    for (int i = 0; i < pipeline->count; i++) {
+        int dependency = pipeline_dependency(pipeline, i);
+        if (dependency >= 0) {
+            pthread_mutex_lock(&pipeline->lock);
+            while (pipeline->saved <= dependency) pthread_cond_wait(&pipeline->saved_cond, &pipeline->lock);
+            pthread_mutex_unlock(&pipeline->lock);
+        }
+
+        pipeline_load(pipeline->jobs[i]);
+        spsc_queue_push(pipeline->loaded, pipeline->jobs[i]);
+    }
+    spsc_queue_push(pipeline->loaded, NULL);
+    return NULL;
+}
+
+/**
+ * Writer thread: save jobs until NULL
+ */
+static void *pipeline_writer(void *data) {
+    BatchPipeline *pipeline = (BatchPipeline *)data;
+    BatchJob *job;
+
+    while ((job = (BatchJob *)spsc_queue_pop(pipeline->transformed)) != NULL) {
+        pipeline_save_next(pipeline, job);
+    }
+    return NULL;
+}
+#endif
+
+/**
+ * Transform stage on the calling thread
+ */
+static void pipeline_run_job(BatchWorker *state, BatchJob *job, int num_threads) {
+    StegoContext *ctx = state->ctx;
+    state->error[0] = '\0';
+
+    ctx->config = job->config;
+    ctx->config.num_threads = num_threads;
+
+    // A job whose inputs failed to load only passes through
+    if (job->message[0] == '\0') {
+        job->status = pipeline_transform(ctx, job);
+        if (job->status != 0) {
+            snprintf(job->message, sizeof(job->message), "%s", state->error[0] ? state->error : "Failed");
+        }
+    }
+    job->worker = 0;
+}
+
+/**
+ * Run a manifest through load, transform and save stages that overlap
+ */
+int stego_batch_pipeline(const char *manifest_file, FILE *report, const StegoConfig *defaults, int num_threads) {
+    StegoConfig default_config;
+    if (!defaults) {
+        default_config = create_default_config();
+        defaults = &default_config;
+    }
+
+    BatchJob *jobs = NULL;
+    int count = read_manifest(manifest_file, defaults, &jobs);
+    if (count < 0) return -1;
+
+    BatchPipeline pipeline;
+    BatchWorker state;
+    memset(&state, 0, sizeof(state));
+
+    pipeline.jobs = (BatchJob **)malloc((count > 0 ? count : 1) * sizeof(BatchJob *));
+    pipeline.count = 0;
+    pipeline.loaded = spsc_queue_create(BATCH_PIPELINE_DEPTH);
+    pipeline.transformed = spsc_queue_create(BATCH_PIPELINE_DEPTH);
+    state.ctx = stego_context_create(defaults);
+
+    int failed = -1;
+    if (pipeline.jobs && pipeline.loaded && pipeline.transformed && state.ctx) {
+        stego_context_set_log(state.ctx, batch_log, &state);
+        for (int i = 0; i < count; i++) {
+            if (jobs[i].operation != BATCH_INVALID) pipeline.jobs[pipeline.count++] = &jobs[i];
+        }
+        batch_identify_files(jobs, count);
+
+#ifdef _WIN32
+        // Without pthreads the stages run one after the other
+        for (int i = 0; i < pipeline.count; i++) {
+            pipeline_load(pipeline.jobs[i]);
+            pipeline_run_job(&state, pipeline.jobs[i], num_threads);
+            pipeline_save(pipeline.jobs[i]);
+        }
+#else
+        pthread_mutex_init(&pipeline.lock, NULL);
+        pthread_cond_init(&pipeline.saved_cond, NULL);
+        pipeline.saved = 0;
+
+        pthread_t reader, writer;
+        int have_reader = pthread_create(&reader, NULL, pipeline_reader, &pipeline) == 0;
+        int have_writer = have_reader && pthread_create(&writer, NULL, pipeline_writer, &pipeline) == 0;
+
+        if (have_writer) {
+            BatchJob *job;
+            while ((job = (BatchJob *)spsc_queue_pop(pipeline.loaded)) != NULL) {
+                pipeline_run_job(&state, job, num_threads);
+                spsc_queue_push(pipeline.transformed, job);
+            }
+            spsc_queue_push(pipeline.transformed, NULL);
+            pthread_join(writer, NULL);
+        } else if (have_reader) {
+            // Drain the reader so it can finish, and drop what it loaded
+            BatchJob *job;
+            while ((job = (BatchJob *)spsc_queue_pop(pipeline.loaded)) != NULL) {
+                snprintf(job->message, sizeof(job->message), "Failed to start writer thread");
+                pipeline_save_next(&pipeline, job);
+            }
+        }
+        if (have_reader) pthread_join(reader, NULL);
+
+        pthread_cond_destroy(&pipeline.saved_cond);
+        pthread_mutex_destroy(&pipeline.lock);
+#endif
+
+        write_report(report, jobs, count);
+        failed = 0;
+        for (int i = 0; i < count; i++) {
+            if (jobs[i].status != 0) failed++;
+        }
+    } else {
+        fprintf(stderr, "Error: Failed to allocate batch pipeline\n");
+    }
+
+    stego_context_destroy(state.ctx);
+    spsc_queue_destroy(pipeline.transformed);
+    spsc_queue_destroy(pipeline.loaded);
+    for (int i = 0; i < count; i++) free(jobs[i].text);
+    free(pipeline.jobs);
+    free(jobs);
+    return failed;
+}
@@ -0,0 +1,213 @@
+/**
+ * stego_cache.c
+ * Storage of transformed-cover caches
+ *
+ * A cache file is a fixed header of uint64 fields followed by the int32
+ * coefficients exactly as they sit in memory, both in native byte order, so
+ * a loaded cache is a read-only mapping of the file with no copy or parsing.
+ * The file is only meant for machines of the byte order that wrote it.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "stego_internal.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * "STENCCH1" read as a little-endian uint64 (a file from a machine of the
+ * other byte order fails the magic check)
+ */
+#define COVER_CACHE_MAGIC 0x3148434343454E53ULL
+#define COVER_CACHE_VERSION 1
+
+/**
+ * Header of a cache file; its size keeps the coefficients 64-byte aligned
+ */
+typedef struct {
+    uint64_t magic;
+    uint64_t version;
+    uint64_t width;
+    uint64_t height;
+    uint64_t block_size;
+    uint64_t hash;
+    uint64_t cached_blocks;
+    uint64_t reserved;
+} CoverCacheHeader;
+
+/**
+ * FNV-1a hash of a view's pixels, row by row
+ */
+uint64_t stego_cover_hash(const PGMImageView *view) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (int y = 0; y < view->height; y++) {
+        const unsigned char *row = view->data + (size_t)y * view->stride;
+        for (int x = 0; x < view->width; x++) {
+            hash = (hash ^ row[x]) * 0x100000001b3ULL;
+        }
+    }
+
+    return hash;
+}
+
+/**
+ * Cached coefficients of image block `block`
+ */
+const int32_t* stego_cover_cache_block(const StegoCoverCache *cache, int64_t block) {
+    return cache->coefficients + block * cache->block_size * cache->block_size;
+}
+
+/**
+ * Free a cache (or unmap a loaded one)
+ */
+void stego_cover_cache_free(StegoCoverCache *cache) {
+    if (!cache) return;
+
+#ifndef _WIN32
+    if (cache->mapping) {
+        munmap(cache->mapping, cache->mapping_size);
+        free(cache);
+        return;
+    }
+#endif
+
+    free(cache->coefficients);
+    free(cache);
+}
+
+/**
+ * Write a cache to a file
+ */
+int stego_cover_cache_save(const StegoCoverCache *cache, const char *filename) {
+    if (!cache || !filename) return -1;
+
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open file %s for writing\n", filename);
+        return -1;
+    }
+
+    CoverCacheHeader header = {
+        COVER_CACHE_MAGIC, COVER_CACHE_VERSION, (uint64_t)cache->width, (uint64_t)cache->height,
+        (uint64_t)cache->block_size, cache->hash, (uint64_t)cache->cached_blocks, 0
+    };
+    size_t coefs = (size_t)cache->cached_blocks * cache->block_size * cache->block_size;
+
+    int status = fwrite(&header, sizeof(header), 1, file) == 1 ? 0 : -1;
+    if (status == 0 && coefs > 0 && fwrite(cache->coefficients, sizeof(int32_t), coefs, file) != coefs) {
+        status = -1;
+    }
+    if (fclose(file) != 0) status = -1;
+
+    if (status != 0) {
+        fprintf(stderr, "Error: Failed to write cover cache %s\n", filename);
+        remove(filename);
+    }
+    return status;
+}
+
+/**
+ * Check a cache header against the file size and the cover it should match
+ */
+static int cover_cache_header_valid(const CoverCacheHeader *header, size_t size, const PGMImageView *cover) {
+    if (header->magic != COVER_CACHE_MAGIC || header->version != COVER_CACHE_VERSION) return 0;
+    if (header->width != (uint64_t)cover->width || header->height != (uint64_t)cover->height) return 0;
+    if (header->block_size == 0 || header->block_size > (uint64_t)cover->width ||
+        header->block_size > (uint64_t)cover->height) return 0;
+
+    uint64_t blocks = (header->width / header->block_size) * (header->height / header->block_size);
+    if (header->cached_blocks > blocks) return 0;
+
+    uint64_t bytes = header->cached_blocks * header->block_size * header->block_size * sizeof(int32_t);
+    if (size != sizeof(CoverCacheHeader) + bytes) return 0;
+
+    // Hash last: it reads every cover pixel
+    return header->hash == stego_cover_hash(cover);
+}
+
+/**
+ * Map a cache file saved for a cover
+ */
+StegoCoverCache* stego_cover_cache_load(const char *filename, const PGMImageView *cover) {
+    if (!filename || !cover || !cover->data) return NULL;
+
+    StegoCoverCache *cache = (StegoCoverCache *)calloc(1, sizeof(StegoCoverCache));
+    if (!cache) return NULL;
+
+#ifdef _WIN32
+    // No mmap: read the coefficients onto the heap
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        free(cache);
+        return NULL;
+    }
+
+    CoverCacheHeader header;
+    long size = -1;
+    if (fread(&header, sizeof(header), 1, file) == 1 && fseek(file, 0, SEEK_END) == 0) {
+        size = ftell(file);
+    }
+    if (size < 0 || !cover_cache_header_valid(&header, (size_t)size, cover)) {
+        fclose(file);
+        free(cache);
+        return NULL;
+    }
+
+    size_t bytes = (size_t)size - sizeof(header);
+    cache->coefficients = (int32_t *)pgm_alloc_pixels(bytes);
+    if (!cache->coefficients || fseek(file, (long)sizeof(header), SEEK_SET) != 0 ||
+        (bytes > 0 && fread(cache->coefficients, 1, bytes, file) != bytes)) {
+        fclose(file);
+        stego_cover_cache_free(cache);
+        return NULL;
+    }
+    fclose(file);
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        free(cache);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(CoverCacheHeader)) {
+        close(fd);
+        free(cache);
+        return NULL;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // The mapping keeps the file referenced
+
+    if (mapping == MAP_FAILED) {
+        free(cache);
+        return NULL;
+    }
+
+    const CoverCacheHeader *mapped = (const CoverCacheHeader *)mapping;
+    if (!cover_cache_header_valid(mapped, size, cover)) {
+        munmap(mapping, size);
+        free(cache);
+        return NULL;
+    }
+
+    CoverCacheHeader header = *mapped;
+    cache->coefficients = (int32_t *)((unsigned char *)mapping + sizeof(CoverCacheHeader));
+    cache->mapping = mapping;
+    cache->mapping_size = size;
+#endif
+
+    cache->width = (int)header.width;
+    cache->height = (int)header.height;
+    cache->block_size = (int)header.block_size;
+    cache->hash = header.hash;
+    cache->cached_blocks = (int64_t)header.cached_blocks;
+    return cache;
+}
@@ -0,0 +1,143 @@
+/**
+ * stego_context.c
+ * Per-caller library state: configuration, worker pool, random generator
+ * and log callback
+ */
+
+#include "stego_internal.h"
+
+#include <stdarg.h>
+
+/**
+ * Longest message handed to a log callback
+ */
+#define STEGO_LOG_MESSAGE_MAX 512
+
+/**
+ * Default log callback: errors to stderr, everything else dropped
+ */
+static void default_log(void *user, StegoLogLevel level, const char *message) {
+    (void)user;
+    if (level == STEGO_LOG_ERROR) {
+        fprintf(stderr, "Error: %s\n", message);
+    }
+}
+
+/**
+ * Report a printf-style message through a context's log callback
+ */
+void stego_log(StegoContext *ctx, StegoLogLevel level, const char *format, ...) {
+    if (!ctx->log) return;
+
+    char message[STEGO_LOG_MESSAGE_MAX];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    ctx->log(ctx->log_user, level, message);
+}
+
+/**
+ * Advance a splitmix64 generator state and return its next value
+ */
+uint64_t stego_random_next(uint64_t *state) {
+    uint64_t x = (*state += 0x9E3779B97F4A7C15ULL);
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * Create a context
+ */
+StegoContext* stego_context_create(const StegoConfig *config) {
+    StegoContext *ctx = (StegoContext *)calloc(1, sizeof(StegoContext));
+    if (!ctx) return NULL;
+
+    ctx->config = config ? *config : create_default_config();
+    ctx->log = default_log;
+    ctx->rng_state = ctx->config.random_seed;
+    return ctx;
+}
+
+/**
+ * Destroy a context
+ */
+void stego_context_destroy(StegoContext *ctx) {
+    if (!ctx) return;
+
+    stego_context_release_scratch(ctx);
+    thread_pool_destroy(ctx->pool);
+    free(ctx->arena);
+    free(ctx);
+}
+
+/**
+ * Configuration of a context
+ */
+StegoConfig* stego_context_config(StegoContext *ctx) {
+    return &ctx->config;
+}
+
+/**
+ * Replace the log callback of a context
+ */
+void stego_context_set_log(StegoContext *ctx, StegoLogFn log, void *user) {
+    ctx->log = log;
+    ctx->log_user = user;
+}
+
+/**
+ * Have every later embed through a context fill in a report
+ */
+void stego_context_set_embed_report(StegoContext *ctx, StegoEmbedReport *report) {
+    ctx->report = report;
+}
+
+/**
+ * Reseed the context's random generator
+ */
+void stego_context_seed(StegoContext *ctx, uint64_t seed) {
+    ctx->rng_state = seed;
+}
+
+/**
+ * Next value of the context's random generator
+ */
+uint64_t stego_context_random(StegoContext *ctx) {
+    return stego_random_next(&ctx->rng_state);
+}
+
+/**
+ * Worker pool for the context's current num_threads
+ */
+ThreadPool* stego_context_pool(StegoContext *ctx) {
+    int threads = ctx->config.num_threads;
+
+    if (ctx->pool && ctx->pool_threads != threads) {
+        thread_pool_destroy(ctx->pool);
+        ctx->pool = NULL;
+    }
+
+    // Single-threaded configurations (or a failed pool) stay on the calling thread
+    if (!ctx->pool && threads != 1) {
+        ctx->pool = thread_pool_create(threads);
+        ctx->pool_threads = threads;
+    }
+
+    return ctx->pool;
+}
+
+/**
+ * Pixel buffer of at least `size` bytes owned by the context
+ */
+unsigned char* stego_context_arena(StegoContext *ctx, size_t size) {
+    if (size > ctx->arena_size) {
+        free(ctx->arena);
+        ctx->arena = pgm_alloc_pixels(size);
+        ctx->arena_size = ctx->arena ? size : 0;
+    }
+
+    return ctx->arena;
+}
@@ -0,0 +1,217 @@
+/**
+ * stego_detect.c
+ * Payload detection across files and directory trees
+ *
+ * Detection decodes only the stego header, which sits in the top-left 8x8
+ * pixels whatever the block size, so a file costs its PGM header and eight
+ * short reads. The tree walk only collects paths; the files are then
+ * examined on a work-stealing pool, so many reads are in flight at once and
+ * the latency of cold files overlaps.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "stego_internal.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+/**
+ * Growable list of file paths
+ */
+typedef struct {
+    char **paths;
+    int count;
+    int capacity;
+} PathList;
+
+/**
+ * One parallel detection pass over a path list
+ */
+typedef struct {
+    char **paths;
+    StegoHeader *headers;       // Header of each file that carries one
+    signed char *found;         // stego_detect_file result of each file
+} DetectRun;
+
+/**
+ * Check whether a PGM file carries a payload, reading only its header pixels
+ */
+int stego_detect_file(const char *filename, StegoHeader *header) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) return -1;
+
+    // Check the magic number first so that other files are skipped quietly
+    char magic[2];
+    int width, height, max_gray;
+    if (fread(magic, 1, 2, file) != 2 || magic[0] != 'P' || magic[1] != '5' ||
+        fseek(file, 0, SEEK_SET) != 0 || read_pgm_header(file, &width, &height, &max_gray) != 0) {
+        fclose(file);
+        return -1;
+    }
+
+    if (width < STEGO_HEADER_SIZE || height < STEGO_HEADER_SIZE || max_gray > 255) {
+        fclose(file);
+        return 0;
+    }
+
+    // Only the first STEGO_HEADER_SIZE pixels of the first rows
+    unsigned char pixels[STEGO_HEADER_SIZE * STEGO_HEADER_SIZE];
+    long start = ftell(file);
+    int status = start >= 0 ? 0 : -1;
+    for (int y = 0; status == 0 && y < STEGO_HEADER_SIZE; y++) {
+        if (fseek(file, start + (long)y * width, SEEK_SET) != 0 ||
+            fread(pixels + y * STEGO_HEADER_SIZE, 1, STEGO_HEADER_SIZE, file) != STEGO_HEADER_SIZE) {
+            status = -1;
+        }
+    }
+    fclose(file);
+    if (status != 0) return -1;
+
+    PGMImageView view = { pixels, STEGO_HEADER_SIZE, STEGO_HEADER_SIZE, STEGO_HEADER_SIZE };
+    return stego_header_read(&view, header) == 0 ? 1 : 0;
+}
+
+/**
+ * Append a copy of a path to a list
+ * @return 0 on success, -1 on allocation failure
+ */
+static int path_list_add(PathList *list, const char *path) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity > 0 ? list->capacity * 2 : 256;
+        char **paths = (char **)realloc(list->paths, capacity * sizeof(char *));
+        if (!paths) return -1;
+        list->paths = paths;
+        list->capacity = capacity;
+    }
+
+    size_t length = strlen(path) + 1;
+    list->paths[list->count] = (char *)malloc(length);
+    if (!list->paths[list->count]) return -1;
+    memcpy(list->paths[list->count++], path, length);
+    return 0;
+}
+
+/**
+ * Order paths by name
+ */
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * Add a file, or every file under a directory, to a list
+ * @param follow Follow a symbolic link at `path` (only for paths the caller named)
+ * @return 0 on success, -1 on allocation failure
+ */
+static int collect_paths(const char *path, PathList *list, int follow) {
+    struct stat st;
+#ifdef _WIN32
+    (void)follow;
+    int status = stat(path, &st);
+#else
+    int status = follow ? stat(path, &st) : lstat(path, &st);
+
+    // A link to a file is scanned; a link to a directory could loop
+    if (status == 0 && S_ISLNK(st.st_mode)) {
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) return 0;
+    }
+#endif
+    if (status != 0) {
+        fprintf(stderr, "Error: Cannot read %s\n", path);
+        return 0;
+    }
+
+    if (S_ISREG(st.st_mode)) return path_list_add(list, path);
+    if (!S_ISDIR(st.st_mode)) return 0;
+
+    DIR *dir = opendir(path);
+    if (!dir) {
+        fprintf(stderr, "Error: Cannot open directory %s\n", path);
+        return 0;
+    }
+
+    // Entries in name order, so reports do not depend on the file system
+    PathList entries = { NULL, 0, 0 };
+    size_t base = strlen(path);
+    int result = 0;
+    struct dirent *entry;
+    while (result == 0 && (entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+        char *child = (char *)malloc(base + strlen(entry->d_name) + 2);
+        if (!child) {
+            result = -1;
+            break;
+        }
+        sprintf(child, "%s%s%s", path, base > 0 && path[base - 1] == '/' ? "" : "/", entry->d_name);
+        result = path_list_add(&entries, child);
+        free(child);
+    }
+    closedir(dir);
+
+    if (result == 0) qsort(entries.paths, entries.count, sizeof(char *), compare_paths);
+    for (int i = 0; result == 0 && i < entries.count; i++) {
+        result = collect_paths(entries.paths[i], list, 0);
+    }
+
+    for (int i = 0; i < entries.count; i++) free(entries.paths[i]);
+    free(entries.paths);
+    return result;
+}
+
+/**
+ * Task callback: examine one file
+ */
+static void detect_task(void *arg, int64_t begin, int64_t end, int worker) {
+    DetectRun *run = (DetectRun *)arg;
+    (void)end;
+    (void)worker;
+
+    run->found[begin] = (signed char)stego_detect_file(run->paths[begin], &run->headers[begin]);
+}
+
+/**
+ * Detect payloads in files and directory trees
+ */
+int stego_detect_scan(const char *const *paths, int count, FILE *report, int num_threads, int *scanned) {
+    PathList list = { NULL, 0, 0 };
+    int status = 0;
+
+    for (int i = 0; status == 0 && i < count; i++) {
+        status = collect_paths(paths[i], &list, 1);
+    }
+
+    DetectRun run;
+    run.paths = list.paths;
+    run.headers = (StegoHeader *)malloc((list.count > 0 ? list.count : 1) * sizeof(StegoHeader));
+    run.found = (signed char *)malloc(list.count > 0 ? list.count : 1);
+
+    int detected = -1;
+    if (status == 0 && run.headers && run.found) {
+        ThreadPool *pool = num_threads != 1 && list.count > 1 ? thread_pool_create(num_threads) : NULL;
+        thread_pool_run_tasks(pool, list.count, detect_task, &run);
+        thread_pool_destroy(pool);
+
+        detected = 0;
+        for (int i = 0; i < list.count; i++) {
+            if (run.found[i] != 1) continue;
+
+            const StegoHeader *header = &run.headers[i];
+            fprintf(report, "%s\t%d\t%d\t%d\t%d\t%s\t%s\n", list.paths[i],
+                    header->secret_width, header->secret_height, header->block_size,
+                    header->embedding_strength, header->use_random_blocks ? "random" : "sequential",
+                    header->transform == STEGO_TRANSFORM_LIFTING ? "lifting" : "haar");
+            detected++;
+        }
+        if (scanned) *scanned = list.count;
+    } else {
+        fprintf(stderr, "Error: Failed to allocate the detection scan\n");
+    }
+
+    for (int i = 0; i < list.count; i++) free(list.paths[i]);
+    free(list.paths);
+    free(run.headers);
+    free(run.found);
+    return detected;
+}
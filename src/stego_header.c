@@ -0,0 +1,127 @@
+/**
+ * stego_header.c
+ * Self-describing stego header
+ *
+ * The header is 64 bits carried by the top-left 8x8 pixels of the image, one
+ * bit per pixel by quantization index modulation: a pixel carries bit b when
+ * pixel / STEGO_HEADER_STEP has parity b, and writing a bit moves the pixel
+ * to the middle of the nearest step of that parity. Those pixels lie inside
+ * the metadata block at every block size, so a reader finds the header
+ * without knowing the block size or the transform, and pixel noise below
+ * half a step leaves it intact.
+ *
+ * Bit layout (bit k is pixel k in row-major order):
+ *   0-7   magic            20-37 secret width
+ *   8-9   version          38-55 secret height
+ *   10    random blocks    56-63 CRC-8 of bits 0-55
+ *   11    lifting transform
+ *   12-15 embedding strength
+ *   16-19 log2(block size)
+ */
+
+#include "stego_internal.h"
+
+/**
+ * Pixel values per quantization step; writing a bit moves a pixel by at
+ * most one and a half steps
+ */
+#define STEGO_HEADER_STEP 8
+
+#define STEGO_HEADER_MAGIC 0xB5
+#define STEGO_HEADER_DIM_BITS 18
+
+/**
+ * CRC-8 (polynomial 0x07, initial value 0xFF) of the low `bytes` bytes of a word
+ */
+static unsigned char header_crc(uint64_t bits, int bytes) {
+    unsigned char crc = 0xFF;
+
+    for (int i = 0; i < bytes; i++) {
+        crc ^= (unsigned char)(bits >> (8 * i));
+        for (int k = 0; k < 8; k++) {
+            crc = (unsigned char)(crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1);
+        }
+    }
+
+    return crc;
+}
+
+/**
+ * Write the header into the top-left pixels of a view
+ */
+int stego_header_write(const PGMImageView *view, const StegoHeader *header) {
+    int log2_block = 0;
+    while ((1 << log2_block) < header->block_size && log2_block < 15) log2_block++;
+
+    if (view->width < STEGO_HEADER_SIZE || view->height < STEGO_HEADER_SIZE ||
+        (1 << log2_block) != header->block_size ||
+        header->embedding_strength < 0 || header->embedding_strength > 15 ||
+        header->secret_width <= 0 || header->secret_width >= (1 << STEGO_HEADER_DIM_BITS) ||
+        header->secret_height <= 0 || header->secret_height >= (1 << STEGO_HEADER_DIM_BITS)) {
+        return -1;
+    }
+
+    uint64_t bits = STEGO_HEADER_MAGIC
+                  | (uint64_t)STEGO_HEADER_VERSION << 8
+                  | (uint64_t)(header->use_random_blocks != 0) << 10
+                  | (uint64_t)(header->transform == STEGO_TRANSFORM_LIFTING) << 11
+                  | (uint64_t)header->embedding_strength << 12
+                  | (uint64_t)log2_block << 16
+                  | (uint64_t)header->secret_width << 20
+                  | (uint64_t)header->secret_height << 38;
+    bits |= (uint64_t)header_crc(bits, 7) << 56;
+
+    for (int k = 0; k < STEGO_HEADER_SIZE * STEGO_HEADER_SIZE; k++) {
+        unsigned char *pixel = view->data + (size_t)(k / STEGO_HEADER_SIZE) * view->stride + k % STEGO_HEADER_SIZE;
+        int bit = (int)(bits >> k) & 1;
+        int step = *pixel / STEGO_HEADER_STEP;
+
+        // Wrong parity: move to the nearer neighbouring step (one always exists)
+        if ((step & 1) != bit) {
+            int up = step + 1 < 256 / STEGO_HEADER_STEP;
+            int nearer_up = *pixel % STEGO_HEADER_STEP >= STEGO_HEADER_STEP / 2;
+            step += (up && (nearer_up || step == 0)) ? 1 : -1;
+        }
+
+        *pixel = (unsigned char)(step * STEGO_HEADER_STEP + STEGO_HEADER_STEP / 2);
+    }
+
+    return 0;
+}
+
+/**
+ * Decode the header at the top left of a view
+ */
+int stego_header_read(const PGMImageView *view, StegoHeader *header) {
+    if (!view || !view->data || view->width < STEGO_HEADER_SIZE || view->height < STEGO_HEADER_SIZE) {
+        return -1;
+    }
+
+    uint64_t bits = 0;
+    for (int k = 0; k < STEGO_HEADER_SIZE * STEGO_HEADER_SIZE; k++) {
+        unsigned char pixel = view->data[(size_t)(k / STEGO_HEADER_SIZE) * view->stride + k % STEGO_HEADER_SIZE];
+        bits |= (uint64_t)((pixel / STEGO_HEADER_STEP) & 1) << k;
+    }
+
+    if ((bits & 0xFF) != STEGO_HEADER_MAGIC || (bits >> 56) != header_crc(bits, 7)) return -1;
+
+    StegoHeader found;
+    uint64_t dim_mask = ((uint64_t)1 << STEGO_HEADER_DIM_BITS) - 1;
+    found.version = (int)(bits >> 8) & 3;
+    found.use_random_blocks = (int)(bits >> 10) & 1;
+    found.transform = (bits >> 11) & 1 ? STEGO_TRANSFORM_LIFTING : STEGO_TRANSFORM_HAAR;
+    found.embedding_strength = (int)(bits >> 12) & 15;
+    found.block_size = 1 << ((bits >> 16) & 15);
+    found.secret_width = (int)((bits >> 20) & dim_mask);
+    found.secret_height = (int)((bits >> 38) & dim_mask);
+
+    // A header from a newer writer, or fields no writer produces, count as
+    // no header (callers check the fields against the whole image)
+    if (found.version != STEGO_HEADER_VERSION || found.block_size < MIN_EMBED_BLOCK_SIZE ||
+        found.secret_width <= 0 || found.secret_height <= 0) {
+        return -1;
+    }
+
+    if (header) *header = found;
+    return 0;
+}
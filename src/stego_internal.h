@@ -0,0 +1,332 @@
+/**
+ * stego_internal.h
+ * Block-level embedding engine shared by the in-memory and streaming front ends
+ */
+
+#ifndef STEGO_INTERNAL_H
+#define STEGO_INTERNAL_H
+
+#include "../include/steganography.h"
+#include "../include/thread_pool.h"
+
+/**
+ * Smallest block size whose high-frequency quadrant holds the 4x2 embedding
+ * coefficients and the metadata fields
+ */
+#define MIN_EMBED_BLOCK_SIZE 8
+
+/**
+ * Most blocks any codec tile holds (the lifting tile's GLET_D3_INT_LANES;
+ * a Haar tile is a single block)
+ */
+#define BLOCK_CODEC_MAX_LANES 8
+
+/**
+ * Blocks of an image moved into the coefficient domain a tile at a time.
+ * The codec hides which transform is in use: the floating-point Haar tile
+ * runs through the scalar kernels, the lifting tile through the integer
+ * kernels, and embedding/extraction only address coefficients by index.
+ */
+typedef struct {
+    const PGMImageView *view;   // Image whose blocks are read and written
+    int block_size;             // Block size (power of 2)
+    int blocks_x;               // Number of whole blocks per image row
+    StegoTransform transform;   // Which tile and kernels are active
+    int lanes;                  // Number of blocks per tile
+    GletKernel kernel;          // Floating-point kernel (Haar)
+    double embedding_factor;    // Coefficient offset per payload bit (Haar)
+    int32_t lifting_step;       // Minimum coefficient magnitude per payload bit (lifting)
+    void *scratch;              // Single allocation backing tile and workspace
+    double *tile;               // Haar tile, coefficient k of lane l at tile[k * lanes + l]
+    double *workspace;
+    int32_t *int_tile;          // Lifting tile, same layout
+    int32_t *int_workspace;
+} BlockCodec;
+
+/**
+ * Spatial-domain effect of embedding each possible secret byte into a block.
+ * The Haar transform is linear, so moving the 8 payload coefficients by
+ * +/-embedding_factor adds the same pixel delta to every block carrying a
+ * given byte; pattern v holds that delta, rounded the way clip_to_byte rounds
+ * the inverse transform, over the rows x cols corner of the block it touches.
+ */
+typedef struct {
+    int rows;                   // Height of the affected region
+    int cols;                   // Width of the affected region
+    int16_t *deltas;            // 256 patterns of rows * cols pixel deltas
+} DeltaPatterns;
+
+/**
+ * Forward-transformed lifting coefficients of a cover's blocks. Block b's
+ * block_size * block_size coefficients start at coefficients + b * block_size^2,
+ * in image block order (the metadata block included); only the first
+ * cached_blocks blocks are held when the cache was bounded.
+ */
+struct StegoCoverCache {
+    int width, height;          // Cover dimensions
+    int block_size;             // Block size the blocks were transformed at
+    uint64_t hash;              // stego_cover_hash of the cover
+    int64_t cached_blocks;      // Blocks held (0 for Haar, which needs none)
+    int32_t *coefficients;
+    void *mapping;              // File mapping holding coefficients (NULL when on the heap)
+    size_t mapping_size;
+};
+
+/**
+ * FNV-1a hash of a view's pixels, row by row
+ */
+uint64_t stego_cover_hash(const PGMImageView *view);
+
+/**
+ * Cached coefficients of image block `block` (block < cache->cached_blocks)
+ */
+const int32_t* stego_cover_cache_block(const StegoCoverCache *cache, int64_t block);
+
+/**
+ * A payload block whose secret byte changes: its image block index and the
+ * byte it carries before and after
+ */
+typedef struct {
+    int64_t block;
+    unsigned char old_value;
+    unsigned char new_value;
+} PayloadUpdate;
+
+/**
+ * Quality totals of the blocks one worker rewrote during an embed. They are
+ * integers, so merging the workers' totals in any order gives one result.
+ */
+typedef struct {
+    int64_t blocks_changed;
+    uint64_t squared_error;
+    int max_abs_error;
+    uint64_t ssim_deficit;      // Sum of 1 - SSIM over the blocks' 8x8 tiles, in units of 2^-32
+    unsigned char *saved;       // Cover pixels of up to BLOCK_CODEC_MAX_LANES blocks
+} EmbedQuality;
+
+/**
+ * Everything needed to move payload pixels in and out of the blocks of one
+ * image: geometry, block order, worker pool and per-worker embedding state.
+ * Payload pixel i is carried by its own block, so any subset of blocks can
+ * be processed independently and in any order.
+ */
+typedef struct {
+    const StegoConfig *config;  // Configuration of the owning context
+    int block_size;             // Block size (power of 2)
+    int blocks_x;               // Whole blocks per image row
+    int64_t total_blocks;       // Payload blocks: every whole block but the metadata block
+    int64_t payload_pixels;     // Secret pixels carried (at most total_blocks)
+    StegoPermutation permutation; // Random block order
+    ThreadPool *pool;           // Workers (NULL runs on the calling thread)
+    const DeltaPatterns *patterns; // Haar embedding patterns (embedding engines only)
+    BlockCodec *codecs;         // Lifting embedding tiles, one per worker (embedding engines only)
+    const StegoCoverCache *cache; // Transformed cover blocks (NULL transforms every block)
+    EmbedQuality *quality;      // Per-worker quality totals (NULL skips quality tracking)
+} PayloadEngine;
+
+/**
+ * Everything a context keeps between operations. The pool and the embedding
+ * scratch are built on first use and rebuilt only when the configuration
+ * they depend on changes, so a stream of jobs on one context allocates
+ * nothing per job beyond its output.
+ */
+struct StegoContext {
+    StegoConfig config;         // Configuration used by every operation
+    StegoLogFn log;             // Message sink (NULL drops messages)
+    void *log_user;
+    uint64_t rng_state;         // State of the context's random generator
+    ThreadPool *pool;           // Workers (NULL while single-threaded)
+    int pool_threads;           // num_threads the pool was created for
+    DeltaPatterns patterns;     // Haar patterns (deltas NULL until built)
+    int patterns_block_size;    // Block size and strength the patterns were built for
+    int patterns_strength;
+    BlockCodec *codecs;         // Lifting tiles, one per worker
+    int num_codecs;
+    int codecs_block_size;      // Block size and strength the tiles were built for
+    int codecs_strength;
+    unsigned char *arena;       // Reusable pixel buffer (see stego_context_arena)
+    size_t arena_size;
+    StegoEmbedReport *report;   // Filled by every embed (NULL skips quality tracking)
+};
+
+/**
+ * Report a printf-style message through a context's log callback
+ */
+void stego_log(StegoContext *ctx, StegoLogLevel level, const char *format, ...);
+
+/**
+ * Advance a splitmix64 generator state and return its next value
+ */
+uint64_t stego_random_next(uint64_t *state);
+
+/**
+ * Worker pool for the context's current num_threads, created or resized on
+ * demand (NULL when single-threaded or when no worker could be started)
+ */
+ThreadPool* stego_context_pool(StegoContext *ctx);
+
+/**
+ * Free the context's cached embedding scratch
+ */
+void stego_context_release_scratch(StegoContext *ctx);
+
+/**
+ * Pixel buffer of at least `size` bytes owned by the context, reused by later
+ * calls; its contents do not survive a call that has to grow it
+ * @return Buffer, or NULL on allocation failure
+ */
+unsigned char* stego_context_arena(StegoContext *ctx, size_t size);
+
+/**
+ * A band of whole block rows held in memory: the full image, or one strip of
+ * a streamed image. Block indices are those of the full image.
+ */
+typedef struct {
+    const PGMImageView *view;   // Pixels of the band; view->width is the image width
+    int64_t first_block;        // Image block index of the band's top-left block (a row start)
+    int64_t end_block;          // One past the last image block held by the band
+} BlockBand;
+
+/**
+ * Round a requested block size up to a power of 2
+ */
+int resolve_block_size(int requested);
+
+/**
+ * Write the secret dimensions and configuration into the metadata block as
+ * a stego header
+ * @param view Image (or band) holding block 0
+ * @return 0 on success, -1 if they do not fit the header
+ */
+int write_metadata_block(const PGMImageView *view, int block_size, const StegoConfig *config,
+                         int secret_width, int secret_height);
+
+/**
+ * Write a stego header into the top-left pixels of a view
+ * @return 0 on success, -1 if a field does not fit the header
+ */
+int stego_header_write(const PGMImageView *view, const StegoHeader *header);
+
+/**
+ * Read the secret dimensions and configuration from the metadata block
+ * @param view Image (or band) holding block 0
+ * @param block_size Block size of a legacy metadata block (images without a
+ *                   stego header)
+ * @param config Receives block size, strength, random flag and, from a stego
+ *               header, the transform
+ * @return 0 on success, -1 on failure
+ */
+int read_metadata_block(const PGMImageView *view, int block_size, StegoConfig *config,
+                        int *secret_width, int *secret_height);
+
+/**
+ * Embed the metadata block and every payload pixel into an image that
+ * already holds the cover pixels (heap copy or file mapping)
+ * @return 0 on success, -1 on failure
+ */
+int embed_payload(StegoContext *ctx, const PGMImageView *stego, PGMImage *secret);
+
+/**
+ * Resolve the block size and secret dimensions of an extraction, reading
+ * them (and the configuration) from the metadata block when *width or
+ * *height is not positive
+ * @return Block size, or -1 on failure
+ */
+int extract_dimensions(StegoContext *ctx, const PGMImageView *stego, int *width, int *height);
+
+/**
+ * Extract the secret pixels into a caller buffer of width * height bytes
+ * @return 0 on success, -1 on failure
+ */
+int extract_payload(StegoContext *ctx, const PGMImageView *stego, int block_size,
+                    int width, int height, unsigned char *secret);
+
+/**
+ * Set up an engine for an image of the given size on a context's pool and scratch
+ * @param embedding Nonzero to prepare the embedding state as well
+ * @return 0 on success, -1 on failure
+ */
+int payload_engine_init(PayloadEngine *engine, StegoContext *ctx, int block_size,
+                        int image_width, int image_height, int64_t secret_pixels, int embedding);
+
+/**
+ * Release the engine (its pool and scratch stay with the context)
+ */
+void payload_engine_free(PayloadEngine *engine);
+
+/**
+ * Embed every payload pixel into an image held entirely in memory
+ * @param secret Secret pixels in raster order
+ */
+void payload_engine_embed_image(PayloadEngine *engine, const PGMImageView *view, const unsigned char *secret);
+
+/**
+ * Extract every payload pixel from an image held entirely in memory
+ * @param secret Receives the secret pixels in raster order
+ */
+void payload_engine_extract_image(PayloadEngine *engine, const PGMImageView *view, unsigned char *secret);
+
+/**
+ * Embed the payload pixels carried by the blocks of a band
+ * @param secret All secret pixels in raster order
+ */
+void payload_engine_embed_band(PayloadEngine *engine, const BlockBand *band, const unsigned char *secret);
+
+/**
+ * Extract the payload pixels carried by the blocks of a band
+ * @param secret Receives pixel i at secret[i - secret_offset]; every pixel the
+ *               band carries must fall inside the buffer
+ */
+void payload_engine_extract_band(PayloadEngine *engine, const BlockBand *band,
+                                 unsigned char *secret, int64_t secret_offset);
+
+/**
+ * Extract only the payload pixels of a rectangle of the secret, which must
+ * lie inside the secret
+ * @param secret_width Width of the whole secret
+ * @param out Receives region->width * region->height pixels, row by row
+ */
+void payload_engine_extract_region(PayloadEngine *engine, const PGMImageView *view, int secret_width,
+                                   const StegoRegion *region, unsigned char *out);
+
+/**
+ * List the payload blocks whose secret byte differs between two secrets of
+ * the engine's payload size, in ascending block order
+ * @param updates Receives the changes (NULL only counts them)
+ * @return Number of changed blocks
+ */
+int64_t payload_engine_diff(const PayloadEngine *engine, const unsigned char *old_secret,
+                            const unsigned char *new_secret, PayloadUpdate *updates);
+
+/**
+ * Have the engine's embeds compare every block they rewrite with its cover
+ * pixels, into per-worker totals freed with the engine
+ * @return 0 on success, -1 on allocation failure
+ */
+int payload_engine_track_quality(PayloadEngine *engine);
+
+/**
+ * Keep the cover pixels of a block about to be rewritten in slot `slot`
+ * (0 to BLOCK_CODEC_MAX_LANES - 1) of a worker's quality totals
+ */
+void embed_quality_save(EmbedQuality *quality, const unsigned char *block, size_t stride, int block_size, int slot);
+
+/**
+ * Add the differences between a rewritten block and the cover pixels saved
+ * in slot `slot` to a worker's quality totals
+ */
+void embed_quality_compare(EmbedQuality *quality, const unsigned char *block, size_t stride, int block_size, int slot);
+
+/**
+ * Merge the workers' quality totals into a report for a width x height image
+ */
+void embed_quality_report(const EmbedQuality *quality, int workers, int width, int height, StegoEmbedReport *report);
+
+/**
+ * Rewrite changed payload blocks that were gathered into a column view one
+ * block wide (block k of the column holds image block updates[k].block)
+ */
+void payload_engine_update_blocks(PayloadEngine *engine, const PGMImageView *column,
+                                  const PayloadUpdate *updates, int64_t count);
+
+#endif /* STEGO_INTERNAL_H */
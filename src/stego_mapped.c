@@ -0,0 +1,137 @@
+/**
+ * stego_mapped.c
+ * Embedding directly into a memory-mapped output file
+ *
+ * The output file is created at its final size and its pixel region mapped
+ * shared, so the cover is copied exactly once (into the page cache) and the
+ * payload is embedded in place; the kernel writes the pages back.
+ *
+ * An existing output file is never truncated: the cover may be a mapping of
+ * that very file (an in-place embed), so the stego image is written to a
+ * temporary file beside it and renamed over it once the embed succeeded.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "stego_internal.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Embed a secret image into a cover image, writing the result through a
+ * shared mapping of the output file
+ */
+int stego_context_embed_file(StegoContext *ctx, PGMImage *cover, PGMImage *secret, const char *output_file) {
+    if (!cover || !secret || !cover->data || !secret->data) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Invalid input images");
+        return -1;
+    }
+
+    // Verify that the secret image can fit in the cover image
+    if (cover->width < secret->width || cover->height < secret->height) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Secret image is larger than cover image");
+        return -1;
+    }
+
+#ifdef _WIN32
+    // No mmap: embed into a heap copy and write it out
+    PGMImage *stego = embed_image_with_report(cover, secret, &ctx->config, ctx->report);
+    if (!stego) return -1;
+
+    int status = save_pgm(stego, output_file);
+    free_pgm(stego);
+    return status;
+#else
+    char header[PGM_HEADER_MAX];
+    int header_length = format_pgm_header(header, sizeof(header), cover->width, cover->height, cover->max_gray);
+    if (header_length < 0) return -1;
+
+    size_t pixels = (size_t)cover->width * cover->height;
+    size_t size = header_length + pixels;
+
+    // A regular output file that already exists is replaced by a renamed
+    // temporary file; a new one is created and removed again on failure
+    struct stat st;
+    char *temp = NULL;
+    int created = 0;
+    int fd;
+    if (stat(output_file, &st) == 0 && S_ISREG(st.st_mode)) {
+        temp = (char *)malloc(strlen(output_file) + 8);
+        if (!temp) return -1;
+        sprintf(temp, "%s.XXXXXX", output_file);
+        fd = mkstemp(temp);
+        if (fd >= 0 && fchmod(fd, st.st_mode & 07777) != 0) {
+            close(fd);
+            unlink(temp);
+            fd = -1;
+        }
+    } else {
+        fd = open(output_file, O_RDWR | O_CREAT | O_EXCL, 0644);
+        created = fd >= 0;
+        if (fd < 0 && errno == EEXIST) fd = open(output_file, O_RDWR);
+    }
+    if (fd < 0) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Cannot open file %s for writing", output_file);
+        free(temp);
+        return -1;
+    }
+    const char *written = temp ? temp : output_file;
+
+    // Reserve the blocks up front: a store into a sparse page that the file
+    // system cannot back would raise SIGBUS instead of returning an error.
+    // File systems without fallocate support get a plain (sparse) resize.
+    int err = posix_fallocate(fd, 0, (off_t)size);
+    if (err == EINVAL || err == EOPNOTSUPP) {
+        err = ftruncate(fd, (off_t)size) == 0 ? 0 : errno;
+    }
+    unsigned char *mapping = MAP_FAILED;
+    if (err != 0) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Cannot allocate %zu bytes for %s", size, output_file);
+    } else {
+        mapping = (unsigned char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) stego_log(ctx, STEGO_LOG_ERROR, "Cannot map file %s", output_file);
+    }
+    close(fd);  // The mapping keeps the file referenced
+
+    int status = -1;
+    if (mapping != MAP_FAILED) {
+        // The header and the cover pixels are written once, then the payload
+        // is embedded into the mapped pixels in place
+        memcpy(mapping, header, header_length);
+        memcpy(mapping + header_length, cover->data, pixels);
+
+        PGMImageView stego = { mapping + header_length, cover->width, cover->height, (size_t)cover->width };
+        status = embed_payload(ctx, &stego, secret);
+        if (munmap(mapping, size) != 0) status = -1;
+    }
+
+    if (status == 0 && temp && rename(temp, output_file) != 0) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Cannot replace file %s", output_file);
+        status = -1;
+    }
+
+    // Only a file this call created is removed
+    if (status != 0 && (temp || created)) unlink(written);
+    free(temp);
+    return status;
+#endif
+}
+
+/**
+ * Embed a secret image into a mapped output file through a context that
+ * lives for this call only
+ */
+int embed_image_to_file(PGMImage *cover, PGMImage *secret, const char *output_file, StegoConfig *config) {
+    StegoContext *ctx = stego_context_create(config);
+    if (!ctx) return -1;
+
+    int status = stego_context_embed_file(ctx, cover, secret, output_file);
+    stego_context_destroy(ctx);
+    return status;
+}
@@ -0,0 +1,318 @@
+/**
+ * stego_stream.c
+ * Out-of-core embedding and extraction over block-row strips
+ *
+ * Every payload block lies inside one strip of block_size image rows, so a
+ * strip can be read, embedded (or decoded) and written on its own. Only one
+ * strip of the cover is resident at a time; the payload engine maps each
+ * block of the strip back to the secret pixel it carries.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "stego_internal.h"
+
+#include <sys/stat.h>
+
+/**
+ * Check whether two paths name the same existing file
+ */
+static int same_file(const char *a, const char *b) {
+#ifdef _WIN32
+    // No inode numbers: only identical paths are recognised
+    return strcmp(a, b) == 0;
+#else
+    struct stat sa, sb;
+    return stat(a, &sa) == 0 && stat(b, &sb) == 0 && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+#endif
+}
+
+/**
+ * Embed a secret image into a cover file one block row at a time
+ */
+int stego_context_embed_stream(StegoContext *ctx, const char *cover_file, PGMImage *secret, const char *output_file) {
+    const StegoConfig *config = &ctx->config;
+
+    if (!secret || !secret->data) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Invalid input images");
+        return -1;
+    }
+
+    int block_size = resolve_block_size(config->block_size);
+    if (block_size < MIN_EMBED_BLOCK_SIZE) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Block size must be at least %d", MIN_EMBED_BLOCK_SIZE);
+        return -1;
+    }
+
+    FILE *in = fopen(cover_file, "rb");
+    if (!in) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Cannot open file %s", cover_file);
+        return -1;
+    }
+
+    int width, height, max_gray;
+    if (read_pgm_header(in, &width, &height, &max_gray) != 0) {
+        fclose(in);
+        return -1;
+    }
+
+    // Verify that the secret image can fit in the cover image
+    if (width < secret->width || height < secret->height) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Secret image is larger than cover image");
+        fclose(in);
+        return -1;
+    }
+
+    // The cover is read while the output is written, so they cannot share a file
+    if (same_file(cover_file, output_file)) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Cannot stream %s into itself; write to another file", cover_file);
+        fclose(in);
+        return -1;
+    }
+
+    FILE *out = fopen(output_file, "wb");
+    if (!out) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Cannot open file %s for writing", output_file);
+        fclose(in);
+        return -1;
+    }
+
+    PGMImageView strip = { NULL, width, block_size, (size_t)width };
+    strip.data = (unsigned char *)malloc((size_t)block_size * width * sizeof(unsigned char));
+
+    PayloadEngine engine;
+    memset(&engine, 0, sizeof(PayloadEngine));
+    int status = -1;
+    if (strip.data && write_pgm_header(out, width, height, max_gray) == 0 &&
+        payload_engine_init(&engine, ctx, block_size, width, height, (int64_t)secret->width * secret->height, 1) == 0 &&
+        (!ctx->report || payload_engine_track_quality(&engine) == 0)) {
+        int blocks_x = width / block_size;
+        status = 0;
+
+        // Strips of block_size rows; a partial last strip holds no whole blocks
+        // and passes through unchanged
+        for (int row = 0; row * block_size < height && status == 0; row++) {
+            strip.height = height - row * block_size < block_size ? height - row * block_size : block_size;
+            size_t strip_bytes = (size_t)strip.height * width;
+
+            if (fread(strip.data, 1, strip_bytes, in) != strip_bytes) {
+                stego_log(ctx, STEGO_LOG_ERROR, "Failed to read image data from %s", cover_file);
+                status = -1;
+                break;
+            }
+
+            // The first strip also carries the metadata block
+            int track_metadata = row == 0 && engine.quality && strip.height == block_size && blocks_x > 0;
+            if (track_metadata) embed_quality_save(engine.quality, strip.data, strip.stride, block_size, 0);
+            if (row == 0 && write_metadata_block(&strip, block_size, config, secret->width, secret->height) != 0) {
+                stego_log(ctx, STEGO_LOG_ERROR, "Secret dimensions or configuration do not fit the stego header");
+                status = -1;
+                break;
+            }
+            if (track_metadata) embed_quality_compare(engine.quality, strip.data, strip.stride, block_size, 0);
+
+            if (strip.height == block_size) {
+                BlockBand band = { &strip, (int64_t)row * blocks_x, (int64_t)(row + 1) * blocks_x };
+                payload_engine_embed_band(&engine, &band, secret->data);
+            }
+
+            if (fwrite(strip.data, 1, strip_bytes, out) != strip_bytes) {
+                stego_log(ctx, STEGO_LOG_ERROR, "Failed to write image data to %s", output_file);
+                status = -1;
+            }
+        }
+
+        if (status == 0 && engine.quality) {
+            embed_quality_report(engine.quality, thread_pool_size(engine.pool), width, height, ctx->report);
+        }
+    }
+    payload_engine_free(&engine);
+
+    free(strip.data);
+    fclose(in);
+    if (fclose(out) != 0) status = -1;
+    return status;
+}
+
+/**
+ * Extract a secret image from a stego file one block row at a time
+ */
+static int extract_stream(StegoContext *ctx, const char *stego_file, const char *output_file, int *width, int *height) {
+    StegoConfig *config = &ctx->config;
+
+    int block_size = resolve_block_size(config->block_size);
+    if (block_size < MIN_EMBED_BLOCK_SIZE) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Block size must be at least %d", MIN_EMBED_BLOCK_SIZE);
+        return -1;
+    }
+
+    FILE *in = fopen(stego_file, "rb");
+    if (!in) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Cannot open file %s", stego_file);
+        return -1;
+    }
+
+    int image_width, image_height, max_gray;
+    if (read_pgm_header(in, &image_width, &image_height, &max_gray) != 0) {
+        fclose(in);
+        return -1;
+    }
+    long data_start = ftell(in);
+
+    int secret_width = *width;
+    int secret_height = *height;
+
+    // If dimensions and config not provided, extract them from the first block
+    if (secret_width <= 0 || secret_height <= 0) {
+        int rows = image_height < block_size ? image_height : block_size;
+        PGMImageView first = { NULL, image_width, rows, (size_t)image_width };
+        first.data = (unsigned char *)malloc((size_t)rows * image_width * sizeof(unsigned char));
+
+        int status = -1;
+        if (first.data && fread(first.data, 1, (size_t)rows * image_width, in) == (size_t)rows * image_width) {
+            status = read_metadata_block(&first, block_size, config, &secret_width, &secret_height);
+        }
+        free(first.data);
+
+        // Update block size from extracted config, then go back to the first row
+        block_size = resolve_block_size(config->block_size);
+        if (status == 0 && block_size < MIN_EMBED_BLOCK_SIZE) {
+            stego_log(ctx, STEGO_LOG_ERROR, "Invalid block size extracted: %d", config->block_size);
+            status = -1;
+        } else if (status == 0) {
+            stego_log(ctx, STEGO_LOG_INFO, "Detected block size %d, strength %d, %s blocks",
+                      config->block_size, config->embedding_strength,
+                      config->use_random_blocks ? "random" : "sequential");
+        }
+        if (status != 0 || fseek(in, data_start, SEEK_SET) != 0) {
+            fclose(in);
+            return -1;
+        }
+    }
+
+    // Verify extracted dimensions
+    if (secret_width <= 0 || secret_height <= 0 || secret_width > image_width || secret_height > image_height) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Invalid secret image dimensions extracted: %dx%d", secret_width, secret_height);
+        fclose(in);
+        return -1;
+    }
+
+    if (same_file(stego_file, output_file)) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Cannot stream %s into itself; write to another file", stego_file);
+        fclose(in);
+        return -1;
+    }
+
+    FILE *out = fopen(output_file, "wb");
+    if (!out) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Cannot open file %s for writing", output_file);
+        fclose(in);
+        return -1;
+    }
+
+    int blocks_x = image_width / block_size;
+    int64_t secret_pixels = (int64_t)secret_width * secret_height;
+
+    // Sequential order decodes secret pixels in raster order, one strip's
+    // worth at a time; random order scatters them, so the secret stays whole
+    int64_t buffered = config->use_random_blocks ? secret_pixels : blocks_x;
+    if (buffered < 1) buffered = 1;
+    PGMImageView strip = { NULL, image_width, block_size, (size_t)image_width };
+    strip.data = (unsigned char *)malloc((size_t)block_size * image_width * sizeof(unsigned char));
+    unsigned char *pixels = (unsigned char *)calloc(buffered, sizeof(unsigned char));
+
+    PayloadEngine engine;
+    int status = -1;
+    if (strip.data && pixels && write_pgm_header(out, secret_width, secret_height, max_gray) == 0 &&
+        payload_engine_init(&engine, ctx, block_size, image_width, image_height, secret_pixels, 0) == 0) {
+        int64_t written = 0;
+        status = 0;
+
+        for (int row = 0; (row + 1) * block_size <= image_height; row++) {
+            // Payload positions of this strip (block 0 holds the metadata)
+            int64_t first = row > 0 ? (int64_t)row * blocks_x - 1 : 0;
+            if (!config->use_random_blocks && first >= engine.payload_pixels) break;
+
+            size_t strip_bytes = (size_t)block_size * image_width;
+            if (fread(strip.data, 1, strip_bytes, in) != strip_bytes) {
+                stego_log(ctx, STEGO_LOG_ERROR, "Failed to read image data from %s", stego_file);
+                status = -1;
+                break;
+            }
+
+            BlockBand band = { &strip, (int64_t)row * blocks_x, (int64_t)(row + 1) * blocks_x };
+
+            if (config->use_random_blocks) {
+                payload_engine_extract_band(&engine, &band, pixels, 0);
+                continue;
+            }
+
+            int64_t end = (int64_t)(row + 1) * blocks_x - 1;
+            if (end > engine.payload_pixels) end = engine.payload_pixels;
+
+            payload_engine_extract_band(&engine, &band, pixels, first);
+            if (fwrite(pixels, 1, end - first, out) != (size_t)(end - first)) {
+                status = -1;
+                break;
+            }
+            written = end;
+        }
+
+        if (status == 0 && config->use_random_blocks) {
+            if (fwrite(pixels, 1, secret_pixels, out) != (size_t)secret_pixels) status = -1;
+            written = secret_pixels;
+        }
+
+        // Pixels beyond the cover's capacity are zero, as in extract_image_with_config
+        memset(pixels, 0, buffered);
+        while (status == 0 && written < secret_pixels) {
+            int64_t count = secret_pixels - written < buffered ? secret_pixels - written : buffered;
+            if (fwrite(pixels, 1, count, out) != (size_t)count) status = -1;
+            written += count;
+        }
+
+        if (status != 0) {
+            stego_log(ctx, STEGO_LOG_ERROR, "Failed to write image data to %s", output_file);
+        }
+        payload_engine_free(&engine);
+    }
+
+    free(pixels);
+    free(strip.data);
+    fclose(in);
+    if (fclose(out) != 0) status = -1;
+
+    *width = secret_width;
+    *height = secret_height;
+    return status;
+}
+
+/**
+ * Embed a secret image into a cover file one block row at a time, through a
+ * context that lives for this call only
+ */
+int embed_image_stream(const char *cover_file, PGMImage *secret, const char *output_file, StegoConfig *config) {
+    StegoContext *ctx = stego_context_create(config);
+    if (!ctx) return -1;
+
+    int status = stego_context_embed_stream(ctx, cover_file, secret, output_file);
+    stego_context_destroy(ctx);
+    return status;
+}
+
+/**
+ * Extract a secret image from a stego file one block row at a time, through
+ * a context that lives for this call only
+ */
+int extract_image_stream(const char *stego_file, const char *output_file, int *width, int *height, StegoConfig *config) {
+    StegoContext *ctx = stego_context_create(config);
+    if (!ctx) return -1;
+
+    int status = extract_stream(ctx, stego_file, output_file, width, height);
+
+    // Hand the detected configuration back to the caller
+    if (config) *config = ctx->config;
+
+    stego_context_destroy(ctx);
+    return status;
+}
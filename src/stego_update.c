@@ -0,0 +1,265 @@
+/**
+ * stego_update.c
+ * Rewriting the payload of an existing stego image for a revised secret
+ *
+ * Every payload pixel has a block of its own, so a revision only has to
+ * touch the blocks of the pixels that changed. Those blocks are gathered
+ * into a column one block wide, rewritten there by the payload engine and
+ * copied back (or, for a file, written back with one pwrite per block row
+ * of each run of neighbouring blocks); no other byte of the image is written.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "stego_internal.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/**
+ * The changed blocks of one update, gathered out of the stego image
+ */
+typedef struct {
+    PayloadEngine engine;
+    int block_size;
+    PayloadUpdate *updates;     // Changed blocks in ascending order
+    int64_t count;
+    unsigned char *column;      // count blocks stacked top to bottom
+    PGMImageView column_view;
+} UpdatePlan;
+
+/**
+ * Release an update plan
+ */
+static void update_plan_free(UpdatePlan *plan) {
+    payload_engine_free(&plan->engine);
+    free(plan->updates);
+    free(plan->column);
+    memset(plan, 0, sizeof(UpdatePlan));
+}
+
+/**
+ * Find the blocks of a stego image whose payload changes and rewrite them in
+ * a gathered column; the stego image itself is only read
+ * @return 0 on success, -1 on failure
+ */
+static int update_plan_build(StegoContext *ctx, const PGMImageView *stego, PGMImage *old_secret,
+                             PGMImage *new_secret, UpdatePlan *plan) {
+    memset(plan, 0, sizeof(UpdatePlan));
+
+    if (!new_secret || !new_secret->data) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Invalid secret image");
+        return -1;
+    }
+
+    // The header fixes the layout, as for an extraction; only the seed of a
+    // random order comes from the context. Images without a header keep the
+    // context's configuration.
+    StegoHeader header;
+    if (stego_header_read(stego, &header) == 0) {
+        if (header.secret_width != new_secret->width || header.secret_height != new_secret->height) {
+            stego_log(ctx, STEGO_LOG_ERROR, "New secret is %dx%d but the embedded one is %dx%d; embed it instead",
+                      new_secret->width, new_secret->height, header.secret_width, header.secret_height);
+            return -1;
+        }
+        ctx->config.block_size = header.block_size;
+        ctx->config.embedding_strength = header.embedding_strength;
+        ctx->config.use_random_blocks = header.use_random_blocks;
+        ctx->config.transform = header.transform;
+    }
+
+    int width = new_secret->width, height = new_secret->height;
+    int block_size = extract_dimensions(ctx, stego, &width, &height);
+    if (block_size < 0) return -1;
+
+    if (old_secret && (!old_secret->data || old_secret->width != width || old_secret->height != height)) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Old secret is not %dx%d like the new one; embed the new one instead",
+                  width, height);
+        return -1;
+    }
+
+    // Haar blocks are rewritten by removing the old byte's delta, which a
+    // read-back (lossy under Haar) cannot supply
+    if (!old_secret && ctx->config.transform == STEGO_TRANSFORM_HAAR) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Updating a Haar stego image needs the old secret");
+        return -1;
+    }
+
+    // Without the old secret, the payload carried now stands in for it:
+    // lifting re-marks a block from its own coefficients, so the old byte
+    // only decides which blocks need rewriting
+    unsigned char *extracted = NULL;
+    const unsigned char *old_data = old_secret ? old_secret->data : NULL;
+    if (!old_data) {
+        extracted = (unsigned char *)malloc((size_t)width * height);
+        if (!extracted || extract_payload(ctx, stego, block_size, width, height, extracted) != 0) {
+            stego_log(ctx, STEGO_LOG_ERROR, "Failed to read the current payload");
+            free(extracted);
+            return -1;
+        }
+        old_data = extracted;
+    }
+
+    if (payload_engine_init(&plan->engine, ctx, block_size, stego->width, stego->height,
+                            (int64_t)width * height, 1) != 0) {
+        stego_log(ctx, STEGO_LOG_ERROR, "Failed to allocate embedding buffers");
+        free(extracted);
+        return -1;
+    }
+    plan->block_size = block_size;
+
+    plan->count = payload_engine_diff(&plan->engine, old_data, new_secret->data, NULL);
+    if (plan->count > 0) {
+        size_t block_bytes = (size_t)block_size * block_size;
+        plan->updates = (PayloadUpdate *)malloc((size_t)plan->count * sizeof(PayloadUpdate));
+        plan->column = pgm_alloc_pixels((size_t)plan->count * block_bytes);
+        if (!plan->updates || !plan->column) {
+            stego_log(ctx, STEGO_LOG_ERROR, "Failed to allocate update buffers");
+            free(extracted);
+            update_plan_free(plan);
+            return -1;
+        }
+        payload_engine_diff(&plan->engine, old_data, new_secret->data, plan->updates);
+    }
+    free(extracted);
+
+    // Copy the changed blocks into the column and rewrite them there
+    int blocks_x = stego->width / block_size;
+    for (int64_t k = 0; k < plan->count; k++) {
+        int64_t block = plan->updates[k].block;
+        const unsigned char *src = stego->data + (size_t)(block / blocks_x) * block_size * stego->stride
+                                               + (size_t)(block % blocks_x) * block_size;
+        unsigned char *dst = plan->column + (size_t)k * block_size * block_size;
+        for (int i = 0; i < block_size; i++) {
+            memcpy(dst + (size_t)i * block_size, src + (size_t)i * stego->stride, block_size);
+        }
+    }
+
+    PGMImageView column = { plan->column, block_size, (int)(plan->count * block_size), (size_t)block_size };
+    plan->column_view = column;
+    if (plan->count > 0) {
+        payload_engine_update_blocks(&plan->engine, &plan->column_view, plan->updates, plan->count);
+    }
+
+    stego_log(ctx, STEGO_LOG_INFO, "Rewriting %lld of %lld payload blocks",
+              (long long)plan->count, (long long)plan->engine.payload_pixels);
+    return 0;
+}
+
+/**
+ * Rewrite in place only the blocks of a stego image whose secret pixels changed
+ */
+int64_t stego_context_update(StegoContext *ctx, const PGMImageView *stego, PGMImage *old_secret,
+                             PGMImage *new_secret) {
+    UpdatePlan plan;
+    if (update_plan_build(ctx, stego, old_secret, new_secret, &plan) != 0) return -1;
+
+    int block_size = plan.block_size;
+    int blocks_x = stego->width / block_size;
+    for (int64_t k = 0; k < plan.count; k++) {
+        int64_t block = plan.updates[k].block;
+        unsigned char *dst = stego->data + (size_t)(block / blocks_x) * block_size * stego->stride
+                                         + (size_t)(block % blocks_x) * block_size;
+        const unsigned char *src = plan.column + (size_t)k * block_size * block_size;
+        for (int i = 0; i < block_size; i++) {
+            memcpy(dst + (size_t)i * stego->stride, src + (size_t)i * block_size, block_size);
+        }
+    }
+
+    int64_t count = plan.count;
+    update_plan_free(&plan);
+    return count;
+}
+
+/**
+ * Rewrite only the changed blocks of a stego PGM file
+ */
+int64_t stego_context_update_file(StegoContext *ctx, const char *stego_file, PGMImage *old_secret,
+                                  PGMImage *new_secret) {
+#ifdef _WIN32
+    // No pwrite: update a loaded copy and write the whole file back
+    PGMImage *stego = load_pgm(stego_file);
+    if (!stego) return -1;
+
+    PGMImageView view = pgm_image_view(stego);
+    int64_t count = stego_context_update(ctx, &view, old_secret, new_secret);
+    if (count > 0 && save_pgm(stego, stego_file) != 0) count = -1;
+
+    free_pgm(stego);
+    return count;
+#else
+    // Only the metadata block, the changed blocks and (without an old
+    // secret) the payload blocks are ever read from the mapping
+    PGMImage *stego = load_pgm_mapped(stego_file);
+    if (!stego) return -1;
+
+    PGMImageView view = pgm_image_view(stego);
+    UpdatePlan plan;
+    if (update_plan_build(ctx, &view, old_secret, new_secret, &plan) != 0) {
+        free_pgm(stego);
+        return -1;
+    }
+
+    off_t pixel_offset = (off_t)(stego->data - (unsigned char *)stego->mapping);
+    int block_size = plan.block_size;
+    int blocks_x = stego->width / block_size;
+    int64_t count = plan.count;
+    unsigned char *row = NULL;
+    int fd = -1;
+
+    if (count > 0) {
+        row = (unsigned char *)malloc((size_t)stego->width);
+        fd = open(stego_file, O_WRONLY);
+        if (!row || fd < 0) {
+            stego_log(ctx, STEGO_LOG_ERROR, "Cannot open file %s for writing", stego_file);
+            count = -1;
+        }
+    }
+
+    // Neighbouring blocks of one block row go out together, a pixel row at a time
+    for (int64_t k = 0; count > 0 && k < plan.count; ) {
+        int64_t first = plan.updates[k].block;
+        int64_t run = 1;
+        while (k + run < plan.count && plan.updates[k + run].block == first + run &&
+               (first + run) % blocks_x != 0) {
+            run++;
+        }
+
+        size_t length = (size_t)run * block_size;
+        off_t offset = pixel_offset + (off_t)(first / blocks_x) * block_size * stego->width
+                                    + (off_t)(first % blocks_x) * block_size;
+        for (int i = 0; i < block_size && count > 0; i++) {
+            for (int64_t r = 0; r < run; r++) {
+                memcpy(row + (size_t)r * block_size,
+                       plan.column + ((size_t)(k + r) * block_size + i) * block_size, block_size);
+            }
+            if (pwrite(fd, row, length, offset + (off_t)i * stego->width) != (ssize_t)length) {
+                stego_log(ctx, STEGO_LOG_ERROR, "Failed to write %s", stego_file);
+                count = -1;
+            }
+        }
+        k += run;
+    }
+
+    if (fd >= 0 && close(fd) != 0) count = -1;
+    free(row);
+    update_plan_free(&plan);
+    free_pgm(stego);
+    return count;
+#endif
+}
+
+/**
+ * Rewrite the changed blocks of a stego PGM file through a context that
+ * lives for this call only
+ */
+int64_t update_image_file(const char *stego_file, PGMImage *old_secret, PGMImage *new_secret, StegoConfig *config) {
+    StegoContext *ctx = stego_context_create(config);
+    if (!ctx) return -1;
+
+    int64_t count = stego_context_update_file(ctx, stego_file, old_secret, new_secret);
+    stego_context_destroy(ctx);
+    return count;
+}
@@ -0,0 +1,355 @@
+/**
+ * thread_pool.c
+ * Fixed-size worker pool built on pthreads
+ *
+ * Workers sleep on a condition variable between jobs. A job is a range of
+ * indices split into chunks that workers claim one at a time, so uneven
+ * chunks balance themselves. Task jobs instead deal every worker its own run
+ * of tasks and let idle workers steal from the others. The calling thread
+ * works on the job as worker 0 and returns once every chunk has finished.
+ * Without pthreads (Windows builds) the pool degrades to running each job
+ * on the calling thread.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../include/thread_pool.h"
+
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#define THREAD_POOL_HAVE_PTHREADS 1
+#endif
+
+#ifdef THREAD_POOL_HAVE_PTHREADS
+/**
+ * Tasks [next, end) still queued on one worker
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    int64_t next;
+    int64_t end;
+} TaskRun;
+#endif
+
+struct ThreadPool {
+    int size;                   // Workers including the calling thread
+#ifdef THREAD_POOL_HAVE_PTHREADS
+    pthread_t *threads;         // The size - 1 background workers
+    pthread_mutex_t lock;
+    pthread_cond_t job_ready;   // Signalled when a new job is posted or on shutdown
+    pthread_cond_t job_done;    // Signalled when the last worker leaves a job
+    unsigned long generation;   // Incremented for every posted job
+    int shutdown;
+
+    // Current job, protected by lock
+    ThreadPoolRangeFn fn;
+    void *arg;
+    int64_t count;
+    int64_t chunk;
+    int64_t next;               // First index not yet claimed
+    int busy;                   // Background workers still inside the job
+    int stealing;               // Task job: workers run their own TaskRun
+    TaskRun *runs;              // One per worker
+    int run_count;
+#endif
+};
+
+/**
+ * Number of processors available to this process (at least 1)
+ */
+int thread_pool_cpu_count(void) {
+#ifdef THREAD_POOL_HAVE_PTHREADS
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#else
+    return 1;
+#endif
+}
+
+#ifdef THREAD_POOL_HAVE_PTHREADS
+
+/**
+ * Claim and run chunks of the current job until none are left
+ * Called with the lock held; returns with the lock held.
+ */
+static void run_chunks(ThreadPool *pool, int worker) {
+    while (pool->next < pool->count) {
+        int64_t begin = pool->next;
+        int64_t end = begin + pool->chunk < pool->count ? begin + pool->chunk : pool->count;
+        pool->next = end;
+
+        pthread_mutex_unlock(&pool->lock);
+        pool->fn(pool->arg, begin, end, worker);
+        pthread_mutex_lock(&pool->lock);
+    }
+}
+
+/**
+ * Take the next task of a run
+ * @return 0 if the run is empty
+ */
+static int pop_task(TaskRun *run, int64_t *task) {
+    pthread_mutex_lock(&run->lock);
+    int found = run->next < run->end;
+    if (found) *task = run->next++;
+    pthread_mutex_unlock(&run->lock);
+    return found;
+}
+
+/**
+ * Move the back half of another worker's run into this worker's run
+ * @return 0 if every other run is empty
+ */
+static int steal_tasks(ThreadPool *pool, int worker) {
+    for (int i = 1; i < pool->size; i++) {
+        TaskRun *victim = &pool->runs[(worker + i) % pool->size];
+
+        pthread_mutex_lock(&victim->lock);
+        int64_t remaining = victim->end - victim->next;
+        int64_t end = victim->end;
+        victim->end -= (remaining + 1) / 2;
+        int64_t begin = victim->end;
+        pthread_mutex_unlock(&victim->lock);
+
+        if (remaining > 0) {
+            TaskRun *own = &pool->runs[worker];
+            pthread_mutex_lock(&own->lock);
+            own->next = begin;
+            own->end = end;
+            pthread_mutex_unlock(&own->lock);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Run this worker's tasks, then stolen ones, until no worker has any left
+ * Called with the lock held; returns with the lock held.
+ */
+static void run_tasks(ThreadPool *pool, int worker) {
+    pthread_mutex_unlock(&pool->lock);
+
+    // Tasks are never added during a job, so once every run is empty the
+    // only tasks left are ones other workers already hold
+    for (;;) {
+        int64_t task;
+        if (pop_task(&pool->runs[worker], &task)) {
+            pool->fn(pool->arg, task, task + 1, worker);
+        } else if (!steal_tasks(pool, worker)) {
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&pool->lock);
+}
+
+typedef struct {
+    ThreadPool *pool;
+    int worker;
+} WorkerStart;
+
+/**
+ * Background worker loop
+ */
+static void *worker_main(void *data) {
+    WorkerStart start = *(WorkerStart *)data;
+    ThreadPool *pool = start.pool;
+    free(data);
+
+    // Jobs are numbered from 1, so a worker that starts late still runs the
+    // job that was posted before it got the lock
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+
+    for (;;) {
+        while (!pool->shutdown && pool->generation == seen) {
+            pthread_cond_wait(&pool->job_ready, &pool->lock);
+        }
+        if (pool->shutdown) break;
+
+        seen = pool->generation;
+        if (pool->stealing) {
+            run_tasks(pool, start.worker);
+        } else {
+            run_chunks(pool, start.worker);
+        }
+
+        if (--pool->busy == 0) {
+            pthread_cond_signal(&pool->job_done);
+        }
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+#endif /* THREAD_POOL_HAVE_PTHREADS */
+
+/**
+ * Create a pool with `num_threads` workers including the calling thread
+ */
+ThreadPool* thread_pool_create(int num_threads) {
+    ThreadPool *pool = (ThreadPool *)calloc(1, sizeof(ThreadPool));
+    if (!pool) return NULL;
+
+    if (num_threads <= 0) {
+        num_threads = thread_pool_cpu_count();
+    }
+
+#ifdef THREAD_POOL_HAVE_PTHREADS
+    pool->size = 1;
+    pool->threads = (pthread_t *)malloc(num_threads * sizeof(pthread_t));
+    pool->runs = (TaskRun *)calloc(num_threads, sizeof(TaskRun));
+    if (!pool->threads || !pool->runs) {
+        free(pool->threads);
+        free(pool->runs);
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->job_ready, NULL);
+    pthread_cond_init(&pool->job_done, NULL);
+    for (int i = 0; i < num_threads; i++) {
+        pthread_mutex_init(&pool->runs[i].lock, NULL);
+    }
+    pool->run_count = num_threads;
+
+    // Start the background workers; a pool that gets fewer threads than
+    // asked for still works, just with less parallelism
+    for (int i = 1; i < num_threads; i++) {
+        WorkerStart *start = (WorkerStart *)malloc(sizeof(WorkerStart));
+        if (!start) break;
+        start->pool = pool;
+        start->worker = i;
+
+        if (pthread_create(&pool->threads[i - 1], NULL, worker_main, start) != 0) {
+            free(start);
+            break;
+        }
+        pool->size++;
+    }
+#else
+    (void)num_threads;
+    pool->size = 1;
+#endif
+
+    return pool;
+}
+
+/**
+ * Stop the workers and free the pool
+ */
+void thread_pool_destroy(ThreadPool *pool) {
+    if (!pool) return;
+
+#ifdef THREAD_POOL_HAVE_PTHREADS
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->job_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->size - 1; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    // Runs were initialised for every requested worker, started or not
+    for (int i = 0; i < pool->run_count; i++) {
+        pthread_mutex_destroy(&pool->runs[i].lock);
+    }
+    pthread_cond_destroy(&pool->job_done);
+    pthread_cond_destroy(&pool->job_ready);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->runs);
+    free(pool->threads);
+#endif
+
+    free(pool);
+}
+
+/**
+ * Number of workers in a pool, including the calling thread
+ */
+int thread_pool_size(const ThreadPool *pool) {
+    return pool ? pool->size : 1;
+}
+
+/**
+ * Run fn over [0, count) in chunks on every worker and wait for all of them
+ */
+void thread_pool_parallel_for(ThreadPool *pool, int64_t count, int64_t chunk, ThreadPoolRangeFn fn, void *arg) {
+    if (count <= 0) return;
+    if (chunk < 1) chunk = 1;
+
+    // Small jobs and single-worker pools run inline
+    if (!pool || pool->size == 1 || count <= chunk) {
+        for (int64_t begin = 0; begin < count; begin += chunk) {
+            fn(arg, begin, begin + chunk < count ? begin + chunk : count, 0);
+        }
+        return;
+    }
+
+#ifdef THREAD_POOL_HAVE_PTHREADS
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->count = count;
+    pool->chunk = chunk;
+    pool->next = 0;
+    pool->stealing = 0;
+    pool->busy = pool->size - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->job_ready);
+
+    // Work alongside the background workers, then wait for the stragglers
+    run_chunks(pool, 0);
+    while (pool->busy > 0) {
+        pthread_cond_wait(&pool->job_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+#endif
+}
+
+/**
+ * Run fn once for every task in [0, count), stealing work between workers
+ */
+void thread_pool_run_tasks(ThreadPool *pool, int64_t count, ThreadPoolRangeFn fn, void *arg) {
+    if (count <= 0) return;
+
+    if (!pool || pool->size == 1 || count == 1) {
+        for (int64_t task = 0; task < count; task++) {
+            fn(arg, task, task + 1, 0);
+        }
+        return;
+    }
+
+#ifdef THREAD_POOL_HAVE_PTHREADS
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->stealing = 1;
+
+    // Deal out contiguous runs; no worker has started on them yet, so the
+    // run locks are not needed here
+    for (int i = 0; i < pool->size; i++) {
+        pool->runs[i].next = count * i / pool->size;
+        pool->runs[i].end = count * (i + 1) / pool->size;
+    }
+
+    pool->busy = pool->size - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->job_ready);
+
+    run_tasks(pool, 0);
+    while (pool->busy > 0) {
+        pthread_cond_wait(&pool->job_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+#endif
+}